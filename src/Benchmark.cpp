@@ -0,0 +1,193 @@
+#include "net/Message.hpp"
+#include "net/Connection.hpp"
+
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+// Loopback file transfer throughput and small message round trip time of a single Connection pair
+
+namespace {
+    using namespace boost;
+
+    struct Mode {
+        const char *name;
+        bool tls;
+        bool kernel_offload;
+    };
+
+    struct Preset {
+        const char *name;
+        net::SocketTuning tuning;
+    };
+
+    std::string toPem(const std::function<int(BIO *)> &write) {
+        BIO *bio = BIO_new(BIO_s_mem());
+        write(bio);
+        char *data = nullptr;
+        auto length = BIO_get_mem_data(bio, &data);
+        std::string pem{data, static_cast<size_t>(length)};
+        BIO_free(bio);
+        return pem;
+    }
+
+    // Writes self-signed certificate and its key for "localhost" into the given files
+    void makeSelfSignedCertificate(const filesystem::path &certificate, const filesystem::path &private_key) {
+        EVP_PKEY *key = EVP_EC_gen("prime256v1");
+        X509 *x509 = X509_new();
+        ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+        X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+        X509_gmtime_adj(X509_getm_notAfter(x509), 60 * 60);
+        X509_set_pubkey(x509, key);
+        X509_NAME *name = X509_get_subject_name(x509);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(x509, name);
+        X509_sign(x509, key, EVP_sha256());
+
+        std::ofstream{certificate.string()} << toPem([x509](BIO *bio) { return PEM_write_bio_X509(bio, x509); });
+        std::ofstream{private_key.string()} << toPem([key](BIO *bio) {
+            return PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+        });
+
+        X509_free(x509);
+        EVP_PKEY_free(key);
+    }
+
+    void makeDataFile(const filesystem::path &path, uintmax_t size) {
+        std::mt19937_64 engine{42};
+        std::string block(1 << 20, '\0');
+        std::ofstream ofs{path.string(), std::ios::binary};
+        for (uintmax_t written = 0; written < size; written += block.size()) {
+            for (auto &ch: block)
+                ch = static_cast<char>(engine());
+            ofs.write(block.data(), static_cast<std::streamsize>(std::min<uintmax_t>(block.size(), size - written)));
+        }
+    }
+
+    void transfer(const Mode &mode, const filesystem::path &path,
+                  asio::ssl::context &server_context, asio::ssl::context &client_context,
+                  const Preset &preset = {"default", {}}) {
+        asio::io_context io_context;
+        auto work = asio::make_work_guard(io_context);
+        asio::ip::tcp::acceptor acceptor{io_context, {asio::ip::address_v4::loopback(), 0}};
+        net::applyTuning(acceptor, preset.tuning);
+        asio::ip::tcp::socket client_socket{io_context, asio::ip::tcp::v4()};
+        net::applyBufferSizes(client_socket, preset.tuning);
+        client_socket.connect(acceptor.local_endpoint());
+
+        net::Connection receiver{acceptor.accept(), io_context};
+        net::Connection sender{std::move(client_socket), io_context};
+        receiver.tune(preset.tuning);
+        sender.tune(preset.tuning);
+
+        if (mode.tls) {
+            receiver.enableTls(server_context, mode.kernel_offload);
+            sender.enableTls(client_context, mode.kernel_offload);
+            sender.verifyPeerName("localhost");
+            receiver.handshake(asio::ssl::stream_base::server, [&receiver]() { receiver.readHeader(); });
+            sender.handshake(asio::ssl::stream_base::client);
+        } else {
+            receiver.readHeader();
+        }
+        std::thread context_thread{[&io_context]() { io_context.run(); }};
+
+        auto file_size = filesystem::file_size(path);
+        auto start = std::chrono::steady_clock::now();
+        sender.sendFile(path);
+
+        // File header and then FileTransfer messages until file_size bytes arrive
+        uintmax_t received = 0;
+        while (received < file_size) {
+            auto msg = receiver.popIncoming();
+            if (!msg)
+                break;
+            if (msg->header().msgType() == net::MsgType::FileTransfer)
+                received += msg->body().size();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        work.reset();
+        io_context.stop();
+        context_thread.join();
+
+        std::cout << mode.name << ", " << preset.name << " tuning: "
+                  << received / elapsed.count() / (1 << 20) << " MiB/s";
+        if (mode.kernel_offload)
+            std::cout << (sender.kernelTls() ? " (kernel TLS)" : " (kernel TLS unavailable, OpenSSL used)");
+        std::cout << '\n';
+    }
+
+    // Request and reply are sent as separate header and body writes, which is where Nagle's algorithm
+    // and delayed ACKs stall small messages
+    void roundTrip(const Preset &preset, size_t iterations) {
+        asio::io_context io_context;
+        auto work = asio::make_work_guard(io_context);
+        asio::ip::tcp::acceptor acceptor{io_context, {asio::ip::address_v4::loopback(), 0}};
+        net::applyTuning(acceptor, preset.tuning);
+        asio::ip::tcp::socket client_socket{io_context, asio::ip::tcp::v4()};
+        net::applyBufferSizes(client_socket, preset.tuning);
+        client_socket.connect(acceptor.local_endpoint());
+
+        net::Connection responder{acceptor.accept(), io_context};
+        net::Connection requester{std::move(client_socket), io_context};
+        responder.tune(preset.tuning);
+        requester.tune(preset.tuning);
+        responder.readHeader();
+        requester.readHeader();
+        std::thread context_thread{[&io_context]() { io_context.run(); }};
+        std::thread responder_thread{[&responder, iterations]() {
+            for (size_t i = 0; i < iterations; ++i)
+                if (auto msg = responder.popIncoming())
+                    responder.sendMsg(*msg);
+        }};
+
+        net::Message request{net::Message::MessageHeader{net::MsgType::PlainText}, "ping"};
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            requester.sendMsg(request);
+            requester.popIncoming();
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+        responder_thread.join();
+        work.reset();
+        io_context.stop();
+        context_thread.join();
+
+        std::cout << "round trip, " << preset.name << " tuning: " << elapsed.count() / iterations << " us\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 2) {
+        std::cerr << "Usage: Benchmark.exe [<file size in MiB>]\n";
+        return 1;
+    }
+    uintmax_t size{argc == 2 ? std::stoull(argv[1]) << 20 : 64ull << 20};
+
+    // Per message logging would be measured instead of the transfer
+    std::clog.rdbuf(nullptr);
+
+    auto dir = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(dir);
+    makeSelfSignedCertificate(dir / "cert.pem", dir / "key.pem");
+    makeDataFile(dir / "Data.bin", size);
+
+    auto server_context = net::makeServerTlsContext((dir / "cert.pem").string(), (dir / "key.pem").string());
+    auto client_context = net::makeClientTlsContext((dir / "cert.pem").string());
+
+    for (const auto &mode: {Mode{"plain", false, false},
+                            Mode{"TLS", true, false},
+                            Mode{"kTLS", true, true}})
+        transfer(mode, dir / "Data.bin", server_context, client_context);
+
+    for (const auto &preset: {Preset{"default", {}},
+                              Preset{"latency", net::SocketTuning::latency()},
+                              Preset{"bulk", net::SocketTuning::bulk()}}) {
+        transfer(Mode{"plain", false, false}, dir / "Data.bin", server_context, client_context, preset);
+        roundTrip(preset, 200);
+    }
+
+    filesystem::remove_all(dir);
+    return 0;
+}
@@ -2,8 +2,11 @@
 #include "net/Message.hpp"
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: Client.exe <path to folder that will be used as client root>\n";
+    bool tls = argc > 2 && argv[2] == "--tls"s;
+    bool insecure = argc == 3 && argv[2] == "--tls-insecure"s;
+    if (argc < 2 || argc > 4 || (argc > 2 && !tls && !insecure)) {
+        std::cerr << "Usage: Client.exe <path to folder that will be used as client root>"
+                     " [--tls [<CA file to verify server with>] | --tls-insecure]\n";
         return 1;
     }
     std::string host{"localhost"};
@@ -17,10 +20,14 @@ int main(int argc, char *argv[]) {
 
     net::Client client;
     client.root(root_dir);
+    if (tls)
+        client.enableTls(net::makeClientTlsContext(argc == 4 ? argv[3] : ""));
+    else if (insecure)
+        client.enableTls(net::makeClientTlsContext("", false));
     client.connectToServer(host, port);
 
-    client.sendFile("Data.txt");
+    client.sendChangedFiles({"Data.txt"});
     client.mainLoop();
 
-    return 0;
+    return client.failedFiles() == 0 ? 0 : 1;
 }
\ No newline at end of file
@@ -1,8 +1,9 @@
 #include "net/Server.hpp"
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: Server.exe <path to folder that will be used as server root>\n";
+    if (argc != 2 && argc != 4) {
+        std::cerr << "Usage: Server.exe <path to folder that will be used as server root>"
+                     " [<TLS certificate chain> <TLS private key>]\n";
         return 1;
     }
     uint16_t port{60000};
@@ -15,6 +16,8 @@ int main(int argc, char *argv[]) {
 
     net::Server server{port};
     server.root(root_dir);
+    if (argc == 4)
+        server.enableTls(net::makeServerTlsContext(argv[2], argv[3]));
     server.Start();
     server.mainLoop();
 
@@ -0,0 +1,528 @@
+#ifndef NETWORKING_CATALOG_HPP
+#define NETWORKING_CATALOG_HPP
+
+#include "../pch.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <openssl/evp.h>
+
+#include "FileSync.hpp"
+
+// Catalog of files kept in server storage.
+// It's persisted as a snapshot sorted by name, which is memory mapped and searched in place,
+// plus a journal of later updates and removals replayed into memory at startup.
+// The journal is merged into a new snapshot once it grows large, on a thread of its own
+// so lookups and updates continue meanwhile.
+
+namespace net {
+    using namespace boost;
+
+    using ContentHash = std::array<uint8_t, 32>;
+
+    inline std::string toHex(const ContentHash &hash) {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(hash.size() * 2);
+        for (auto byte: hash) {
+            hex.push_back(digits[byte >> 4]);
+            hex.push_back(digits[byte & 0xf]);
+        }
+        return hex;
+    }
+
+    // Incremental SHA-256 of file content
+    class Sha256 {
+    public:
+        Sha256() :
+                _ctx(EVP_MD_CTX_new()) {
+            reset();
+        }
+
+        Sha256(const Sha256 &) = delete;
+
+        ~Sha256() {
+            EVP_MD_CTX_free(_ctx);
+        }
+
+        void reset() {
+            EVP_DigestInit_ex(_ctx, EVP_sha256(), nullptr);
+        }
+
+        void update(const char *data, size_t length) {
+            EVP_DigestUpdate(_ctx, data, length);
+        }
+
+        ContentHash digest() {
+            ContentHash hash{};
+            EVP_DigestFinal_ex(_ctx, hash.data(), nullptr);
+            reset();
+            return hash;
+        }
+
+        static ContentHash ofFile(const filesystem::path &path) {
+            Sha256 sha;
+            std::ifstream ifs{path.string(), std::ios::binary};
+            std::vector<char> buffer(1 << 16);
+            while (ifs) {
+                ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                sha.update(buffer.data(), static_cast<size_t>(ifs.gcount()));
+            }
+            return sha.digest();
+        }
+
+    private:
+        EVP_MD_CTX *_ctx;
+    };
+
+    // Longest part of a reply line besides the name: tabs, size, mtime, hash and newline
+    constexpr size_t CATALOG_REPLY_OVERHEAD{3 + 20 + 20 + 64 + 1};
+
+    struct CatalogEntry {
+        uint64_t size;
+        int64_t mtime;
+        ContentHash hash;
+    };
+
+    class StorageCatalog {
+    public:
+        static constexpr const char *SNAPSHOT_NAME{".catalog"};
+        static constexpr const char *JOURNAL_NAME{".catalog.journal"};
+        // Journal being merged into a new snapshot
+        static constexpr const char *FROZEN_JOURNAL_NAME{".catalog.journal.1"};
+        // Journal entries merged into snapshot at once
+        static constexpr size_t COMPACTION_THRESHOLD{1 << 16};
+
+        StorageCatalog() = default;
+
+        StorageCatalog(const StorageCatalog &) = delete;
+
+        ~StorageCatalog() {
+            if (_compaction_thread.joinable())
+                _compaction_thread.join();
+        }
+
+        /// @brief Maps the snapshot of root, building it by walking root if there is none
+        void open(const filesystem::path &root) {
+            // Compaction takes the lock before it finishes
+            if (_compaction_thread.joinable())
+                _compaction_thread.join();
+            std::scoped_lock lock(_mutex);
+            _root = root;
+            _overlay.clear();
+            _frozen.clear();
+            _compaction_threshold = COMPACTION_THRESHOLD;
+            _journal.close();
+
+            if (!mapSnapshot()) {
+                std::clog << "[Catalog] Building catalog of " << root << std::endl;
+                for (const auto &file: filesystem::directory_iterator(root)) {
+                    auto name = file.path().filename().string();
+                    if (filesystem::is_regular_file(file.status()) && !hidden(name))
+                        _overlay[name] = CatalogEntry{filesystem::file_size(file.path()),
+                                                      filesystem::last_write_time(file.path()),
+                                                      Sha256::ofFile(file.path())};
+                }
+                compact();
+            } else {
+                replayJournal(FROZEN_JOURNAL_NAME);
+                replayJournal(JOURNAL_NAME);
+                // Compaction was interrupted, its entries are merged before the frozen journal is reused
+                system::error_code ec;
+                if (filesystem::exists(_root / FROZEN_JOURNAL_NAME, ec))
+                    compact();
+            }
+            _journal.open((_root / JOURNAL_NAME).string(), std::ios::binary | std::ios::app);
+            std::clog << "[Catalog] Opened with " << recordCount() << " snapshot and "
+                      << _overlay.size() << " journal entries" << std::endl;
+        }
+
+        /// @brief Records file of storage that has been committed under name
+        void update(const std::string &name, const CatalogEntry &entry) {
+            std::scoped_lock lock(_mutex);
+            _overlay[name] = entry;
+            writeJournalEntry(name, entry);
+            _journal.flush();
+            startCompaction();
+        }
+
+        std::optional<CatalogEntry> find(std::string_view name) {
+            std::scoped_lock lock(_mutex);
+            return findLocked(name);
+        }
+
+        /// @brief Answers batched query
+        /// @details Entries whose file is gone or has different size or modification time are dropped
+        /// @param query file names separated by '\\n'
+        /// @returns line per name: "<name>\\t<size>\\t<mtime>\\t<hash>" or "<name>\\t-" for unknown files
+        std::string answer(std::string_view query) {
+            std::string reply;
+            std::scoped_lock lock(_mutex);
+            while (!query.empty()) {
+                auto end = std::min(query.find('\n'), query.size());
+                auto name = query.substr(0, end);
+                query.remove_prefix(std::min(end + 1, query.size()));
+                if (name.empty())
+                    continue;
+
+                reply.append(name);
+                auto entry = findLocked(name);
+                if (entry && !matchesFile(name, *entry)) {
+                    std::clog << "[Catalog] " << name << " changed outside of storage" << std::endl;
+                    entry.reset();
+                    _overlay[std::string{name}] = std::nullopt;
+                    writeJournalEntry(std::string{name}, std::nullopt);
+                    _journal.flush();
+                    startCompaction();
+                }
+                if (entry) {
+                    reply += '\t' + std::to_string(entry->size) +
+                             '\t' + std::to_string(entry->mtime) +
+                             '\t' + toHex(entry->hash);
+                } else {
+                    reply += "\t-";
+                }
+                reply += '\n';
+            }
+            return reply;
+        }
+
+        // Temporary and catalog files aren't part of storage
+        static bool hidden(std::string_view name) {
+            return !name.empty() && name.front() == '.';
+        }
+
+        /// @brief Name a client may store a file under, directly in root and not hidden
+        static bool storable(std::string_view name) {
+            static constexpr std::string_view separators{"/\\\0", 3};
+            return !name.empty() && !hidden(name) && name.find_first_of(separators) == std::string_view::npos;
+        }
+
+    private:
+        using Overlay = std::map<std::string, std::optional<CatalogEntry>, std::less<>>;
+
+        struct SnapshotHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t count;
+            uint64_t names_size;
+        };
+
+        // Names are stored after all records, name_offset is relative to their start
+        struct SnapshotRecord {
+            uint64_t name_offset;
+            uint32_t name_length;
+            uint32_t reserved;
+            uint64_t size;
+            int64_t mtime;
+            uint8_t hash[32];
+        };
+
+        static constexpr char MAGIC[8]{'N', 'E', 'T', 'C', 'A', 'T', 'L', 'G'};
+        static constexpr uint32_t VERSION{1};
+        // Set in journal name length of removed entry, which has no fields after the name
+        static constexpr uint32_t REMOVED{1u << 31};
+
+        bool matchesFile(std::string_view name, const CatalogEntry &entry) const {
+            auto path = _root / std::string{name};
+            system::error_code ec;
+            auto size = filesystem::file_size(path, ec);
+            if (ec || size != entry.size)
+                return false;
+            auto mtime = filesystem::last_write_time(path, ec);
+            return !ec && mtime == entry.mtime;
+        }
+
+        bool mapSnapshot() {
+            _snapshot = interprocess::mapped_region{};
+            auto path = _root / SNAPSHOT_NAME;
+            system::error_code ec;
+            if (!filesystem::is_regular_file(path, ec) || filesystem::file_size(path, ec) < sizeof(SnapshotHeader))
+                return false;
+
+            try {
+                interprocess::file_mapping mapping{path.string().c_str(), interprocess::read_only};
+                _snapshot = interprocess::mapped_region{mapping, interprocess::read_only};
+            } catch (const interprocess::interprocess_exception &e) {
+                std::cerr << "[Catalog] Can't map snapshot: " << e.what() << std::endl;
+                return false;
+            }
+
+            if (!validSnapshot()) {
+                std::cerr << "[Catalog] Snapshot is corrupted" << std::endl;
+                _snapshot = interprocess::mapped_region{};
+                return false;
+            }
+            return true;
+        }
+
+        // Every record is checked once, so lookups can trust names to lie within the mapping and be sorted
+        bool validSnapshot() const {
+            const auto &header = snapshotHeader();
+            auto payload = _snapshot.get_size() - sizeof(SnapshotHeader);
+            if (!std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic) || header.version != VERSION ||
+                header.count > payload / sizeof(SnapshotRecord) ||
+                header.names_size > payload - header.count * sizeof(SnapshotRecord))
+                return false;
+
+            for (size_t i = 0; i < header.count; ++i) {
+                const auto &current = record(i);
+                if (current.name_offset > header.names_size ||
+                    current.name_length > header.names_size - current.name_offset)
+                    return false;
+                if (i > 0 && !(recordName(record(i - 1)) < recordName(current)))
+                    return false;
+            }
+            return true;
+        }
+
+        const SnapshotHeader &snapshotHeader() const {
+            return *static_cast<const SnapshotHeader *>(_snapshot.get_address());
+        }
+
+        size_t recordCount() const {
+            return _snapshot.get_address() ? snapshotHeader().count : 0;
+        }
+
+        const SnapshotRecord &record(size_t i) const {
+            auto records = static_cast<const char *>(_snapshot.get_address()) + sizeof(SnapshotHeader);
+            return reinterpret_cast<const SnapshotRecord *>(records)[i];
+        }
+
+        std::string_view recordName(const SnapshotRecord &record) const {
+            auto names = static_cast<const char *>(_snapshot.get_address()) + sizeof(SnapshotHeader) +
+                         recordCount() * sizeof(SnapshotRecord);
+            return {names + record.name_offset, record.name_length};
+        }
+
+        static CatalogEntry toEntry(const SnapshotRecord &record) {
+            CatalogEntry entry{record.size, record.mtime, {}};
+            std::copy(std::begin(record.hash), std::end(record.hash), entry.hash.begin());
+            return entry;
+        }
+
+        std::optional<CatalogEntry> findLocked(std::string_view name) const {
+            // Removed entry hides the snapshot record
+            if (auto it = _overlay.find(name); it != _overlay.end())
+                return it->second;
+            if (auto it = _frozen.find(name); it != _frozen.end())
+                return it->second;
+
+            // Binary search over the mapped records
+            size_t first = 0, last = recordCount();
+            while (first < last) {
+                auto middle = first + (last - first) / 2;
+                auto middle_name = recordName(record(middle));
+                if (middle_name == name)
+                    return toEntry(record(middle));
+                if (middle_name < name)
+                    first = middle + 1;
+                else
+                    last = middle;
+            }
+            return std::nullopt;
+        }
+
+        void writeJournalEntry(const std::string &name, const std::optional<CatalogEntry> &entry) {
+            auto name_length = static_cast<uint32_t>(name.size());
+            auto flagged_length = entry ? name_length : name_length | REMOVED;
+            _journal.write(reinterpret_cast<const char *>(&flagged_length), sizeof(flagged_length));
+            _journal.write(name.data(), name_length);
+            if (!entry)
+                return;
+            _journal.write(reinterpret_cast<const char *>(&entry->size), sizeof(entry->size));
+            _journal.write(reinterpret_cast<const char *>(&entry->mtime), sizeof(entry->mtime));
+            _journal.write(reinterpret_cast<const char *>(entry->hash.data()), entry->hash.size());
+        }
+
+        void replayJournal(const char *journal_name) {
+            std::ifstream ifs{(_root / journal_name).string(), std::ios::binary};
+            uint32_t name_length;
+            // Entry torn by a crash is dropped together with everything after it
+            while (ifs.read(reinterpret_cast<char *>(&name_length), sizeof(name_length))) {
+                bool removed = name_length & REMOVED;
+                std::string name(name_length & ~REMOVED, '\0');
+                if (!ifs.read(name.data(), static_cast<std::streamsize>(name.size())))
+                    break;
+                if (removed) {
+                    _overlay[std::move(name)] = std::nullopt;
+                    continue;
+                }
+                CatalogEntry entry{};
+                if (
+                    !ifs.read(reinterpret_cast<char *>(&entry.size), sizeof(entry.size)) ||
+                    !ifs.read(reinterpret_cast<char *>(&entry.mtime), sizeof(entry.mtime)) ||
+                    !ifs.read(reinterpret_cast<char *>(entry.hash.data()), entry.hash.size()))
+                    break;
+                _overlay[std::move(name)] = entry;
+            }
+        }
+
+        /// @brief Merges journal into a new snapshot and starts an empty journal, caller holds the lock
+        void compact() {
+            auto temporary = writeSnapshot(_overlay);
+            if (temporary.empty() || !installSnapshot(temporary))
+                return;
+
+            _journal.close();
+            system::error_code ec;
+            filesystem::remove(_root / FROZEN_JOURNAL_NAME, ec);
+            filesystem::remove(_root / JOURNAL_NAME, ec);
+            _overlay.clear();
+        }
+
+        /// @brief Moves journaled entries aside and merges them into a new snapshot on another thread
+        /// @details Caller holds the lock. Entries recorded meanwhile go to a fresh journal.
+        void startCompaction() {
+            if (_compacting || _overlay.size() < _compaction_threshold)
+                return;
+            // Previous compaction has finished already
+            if (_compaction_thread.joinable())
+                _compaction_thread.join();
+
+            _journal.close();
+            system::error_code ec;
+            filesystem::rename(_root / JOURNAL_NAME, _root / FROZEN_JOURNAL_NAME, ec);
+            _journal.open((_root / JOURNAL_NAME).string(), std::ios::binary | std::ios::app);
+            if (ec) {
+                std::cerr << "[Catalog] Can't set journal aside: " << ec.message() << std::endl;
+                _compaction_threshold = _overlay.size() + COMPACTION_THRESHOLD;
+                return;
+            }
+
+            _frozen = std::move(_overlay);
+            _overlay.clear();
+            _compacting = true;
+            _compaction_thread = std::thread{&StorageCatalog::compactFrozen, this};
+        }
+
+        void compactFrozen() {
+            // Mapped snapshot and frozen entries only change on this thread until compacting is reset
+            auto temporary = writeSnapshot(_frozen);
+
+            std::scoped_lock lock(_mutex);
+            if (!temporary.empty() && installSnapshot(temporary)) {
+                _compaction_threshold = COMPACTION_THRESHOLD;
+            } else {
+                // Frozen entries move back to the journal unless a newer one exists for the name
+                for (const auto &[name, entry]: _frozen) {
+                    if (_overlay.emplace(name, entry).second)
+                        writeJournalEntry(name, entry);
+                }
+                _journal.flush();
+                // Retried once as many entries more are journaled
+                _compaction_threshold = _overlay.size() + COMPACTION_THRESHOLD;
+                if (!syncFile(_root / JOURNAL_NAME)) {
+                    // Frozen journal is replaced by the complete one at the next compaction
+                    std::cerr << "[Catalog] Can't flush journal" << std::endl;
+                    _frozen.clear();
+                    _compacting = false;
+                    return;
+                }
+            }
+            system::error_code ec;
+            filesystem::remove(_root / FROZEN_JOURNAL_NAME, ec);
+            _frozen.clear();
+            _compacting = false;
+        }
+
+        /// @brief Writes mapped snapshot merged with entries to a temporary file and flushes it to disk
+        /// @returns path of the temporary file or empty path on failure
+        filesystem::path writeSnapshot(const Overlay &entries) const {
+            std::vector<SnapshotRecord> records;
+            std::string names;
+            auto append = [&records, &names](std::string_view name, const CatalogEntry &entry) {
+                SnapshotRecord record{names.size(), static_cast<uint32_t>(name.size()), 0,
+                                      entry.size, entry.mtime, {}};
+                std::copy(entry.hash.begin(), entry.hash.end(), record.hash);
+                records.push_back(record);
+                names.append(name);
+            };
+
+            records.reserve(recordCount() + entries.size());
+            size_t i = 0;
+            auto overlay = entries.begin();
+            while (i < recordCount() || overlay != entries.end()) {
+                if (overlay == entries.end() ||
+                    (i < recordCount() && recordName(record(i)) < overlay->first)) {
+                    append(recordName(record(i)), toEntry(record(i)));
+                    ++i;
+                } else {
+                    if (i < recordCount() && recordName(record(i)) == overlay->first)
+                        ++i;
+                    if (overlay->second)
+                        append(overlay->first, *overlay->second);
+                    ++overlay;
+                }
+            }
+
+            SnapshotHeader header{{}, VERSION, 0, records.size(), names.size()};
+            std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+
+            auto temporary = _root / (std::string{SNAPSHOT_NAME} + ".part");
+            {
+                std::ofstream ofs{temporary.string(), std::ios::binary | std::ios::trunc};
+                ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                ofs.write(reinterpret_cast<const char *>(records.data()),
+                          static_cast<std::streamsize>(records.size() * sizeof(SnapshotRecord)));
+                ofs.write(names.data(), static_cast<std::streamsize>(names.size()));
+                ofs.close();
+                if (!ofs) {
+                    std::cerr << "[Catalog] Can't write snapshot" << std::endl;
+                    system::error_code ec;
+                    filesystem::remove(temporary, ec);
+                    return {};
+                }
+            }
+            // Journal may only be dropped once the snapshot replacing it can't be lost
+            if (!syncFile(temporary)) {
+                std::cerr << "[Catalog] Can't flush snapshot" << std::endl;
+                system::error_code ec;
+                filesystem::remove(temporary, ec);
+                return {};
+            }
+            return temporary;
+        }
+
+        /// @brief Replaces the mapped snapshot by the written one, caller holds the lock
+        /// @returns whether the new snapshot is durable and the journal merged into it may be dropped
+        bool installSnapshot(const filesystem::path &temporary) {
+            // Mapped file can't be replaced on Windows
+            _snapshot = interprocess::mapped_region{};
+            system::error_code ec;
+            filesystem::rename(temporary, _root / SNAPSHOT_NAME, ec);
+            if (ec) {
+                // Old snapshot and journal stay valid
+                std::cerr << "[Catalog] Can't replace snapshot: " << ec.message() << std::endl;
+                filesystem::remove(temporary, ec);
+                mapSnapshot();
+                return false;
+            }
+            if (!mapSnapshot()) {
+                std::cerr << "[Catalog] Can't map new snapshot" << std::endl;
+                return false;
+            }
+            // Replaying entries already merged is harmless, so the journal is kept if the rename may be lost
+            if (!syncDirectory(_root)) {
+                std::cerr << "[Catalog] Can't flush catalog directory" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        std::mutex _mutex;
+        filesystem::path _root;
+        interprocess::mapped_region _snapshot;
+        // Removed entries are kept as nullopt until compaction
+        Overlay _overlay;
+        // Entries being merged into a new snapshot, they are journaled in FROZEN_JOURNAL_NAME
+        Overlay _frozen;
+        bool _compacting{false};
+        size_t _compaction_threshold{COMPACTION_THRESHOLD};
+        std::thread _compaction_thread;
+        std::ofstream _journal;
+    };
+}
+
+#endif //NETWORKING_CATALOG_HPP
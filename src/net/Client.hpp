@@ -4,13 +4,15 @@
 #include "../pch.h"
 #include "Message.hpp"
 #include "Connection.hpp"
+#include "Catalog.hpp"
 
 namespace net {
     using namespace boost;
 
     class Client {
     public:
-        Client() :
+        explicit Client(SocketTuning tuning = {}) :
+                _tuning(tuning),
                 _connection(asio::ip::tcp::socket(_io_context), _io_context) {
 
             _connection.setOnMessageHandler(
@@ -28,21 +30,31 @@ namespace net {
         void connectToServer(const std::string &host, const uint16_t port) {
             asio::ip::tcp::resolver resolver(_io_context);
             _endpoints = resolver.resolve(host, std::to_string(port));
+            if (_connection.tls() && !_connection.verifyPeerName(host)) {
+                // Lets mainLoop() return instead of waiting for replies that never come
+                _connection.close();
+                return;
+            }
 
-            asio::async_connect(_connection.socket(), _endpoints,
-                                [this](std::error_code ec, const asio::ip::tcp::endpoint &endpoint) {
-                                    if (!ec) {
-                                        std::clog << "[Client] Connected to Server!\n";
-//                                        _connection.readHeader();
-                                    }
-                                });
+            connect(_endpoints.begin());
         }
 
         // TODO: remove later
         void mainLoop() {
-            _io_context.run();
-//          _context_thread = std::thread([this]() { _io_context.run(); });
-
+            _context_thread = std::thread([this]() { _io_context.run(); });
+            // Sent files are done once Server has committed them
+            while (_files_in_flight > 0 || _queries_in_flight > 0) {
+                auto msg = _connection.popIncoming();
+                if (!msg) {
+                    std::cerr << "[Client] Server closed connection" << std::endl;
+                    // Files waiting for commit and files of unanswered queries won't be committed
+                    _failed_files += _files_in_flight + _queried_files.size();
+                    _files_in_flight = 0;
+                    _queries_in_flight = 0;
+                    break;
+                }
+                msgHandler(*msg);
+            }
         }
 
         void sendMsg(const Message &msg) {
@@ -50,11 +62,82 @@ namespace net {
         }
 
         void sendFile(const boost::filesystem::path &path) {
-            _connection.sendFile(_root_dir / path);
+            if (_connection.sendFile(_root_dir / path))
+                ++_files_in_flight;
+        }
+
+        /// @brief Sends only files which Server doesn't have yet or has with different content
+        /// @details Asks Server's catalog about many files per message,
+        /// batches are small enough for both query and reply to stay far below connection quota
+        void sendChangedFiles(const std::vector<boost::filesystem::path> &paths) {
+            std::string query;
+            size_t reply_size = 0;
+            for (const auto &path: paths) {
+                auto name = path.filename().string();
+                if (!query.empty() && reply_size + name.size() + CATALOG_REPLY_OVERHEAD > QUERY_BATCH_SIZE) {
+                    sendQuery(std::move(query));
+                    query.clear();
+                    reply_size = 0;
+                }
+                _queried_files[name] = path;
+                query += name + '\n';
+                reply_size += name.size() + CATALOG_REPLY_OVERHEAD;
+            }
+            if (!query.empty())
+                sendQuery(std::move(query));
         }
 
         void msgHandler(const Message &msg) {
             std::clog << "[Client]" << msg << std::endl;
+
+            if (msg.header().msgType() == MsgType::FileCommitted) {
+                std::clog << "[Client] Server committed " << msg.body() << std::endl;
+                --_files_in_flight;
+            } else if (msg.header().msgType() == MsgType::FileCommitFailed) {
+                std::cerr << "[Client] Server failed to commit " << msg.body() << std::endl;
+                ++_failed_files;
+                --_files_in_flight;
+            } else if (msg.header().msgType() == MsgType::Heartbeat) {
+                // Shows Server that this side is alive
+                sendMsg(Message{Message::MessageHeader{MsgType::Heartbeat}});
+            } else if (msg.header().msgType() == MsgType::CatalogReply) {
+                handleCatalogReply(msg.body());
+                --_queries_in_flight;
+            }
+        }
+
+        // Reply line is "<name>\t<size>\t<mtime>\t<hash>" or "<name>\t-"
+        void handleCatalogReply(const std::string &reply) {
+            std::istringstream lines{reply};
+            std::string line;
+            while (std::getline(lines, line)) {
+                std::istringstream fields{line};
+                std::string name, size, mtime, hash;
+                std::getline(fields, name, '\t');
+                std::getline(fields, size, '\t');
+                std::getline(fields, mtime, '\t');
+                std::getline(fields, hash, '\t');
+
+                auto it = _queried_files.find(name);
+                if (it == _queried_files.end())
+                    continue;
+                auto path = it->second;
+                _queried_files.erase(it);
+
+                auto local_path = _root_dir.path() / path;
+                if (size != "-" && exists(local_path) &&
+                    std::to_string(filesystem::file_size(local_path)) == size &&
+                    toHex(Sha256::ofFile(local_path)) == hash) {
+                    std::clog << "[Client] Skipping unchanged " << name << std::endl;
+                    continue;
+                }
+                sendFile(path);
+            }
+        }
+
+        /// @brief Number of files Server didn't commit, including ones left when the connection was lost
+        [[nodiscard]] size_t failedFiles() const {
+            return _failed_files;
         }
 
         const filesystem::directory_entry &root() {
@@ -65,12 +148,66 @@ namespace net {
             _root_dir.assign(root);
         }
 
+        /// @brief Must be called before connectToServer(), which sets the host name to verify
+        /// @details See makeClientTlsContext()
+        void enableTls(asio::ssl::context context) {
+            _tls_context.emplace(std::move(context));
+            _connection.enableTls(*_tls_context);
+        }
+
     private:
+        // Largest reply of one catalog query
+        static constexpr size_t QUERY_BATCH_SIZE{1 << 20};
+
+        void sendQuery(std::string query) {
+            ++_queries_in_flight;
+            sendMsg(Message{Message::MessageHeader{MsgType::CatalogQuery}, std::move(query)});
+        }
+
+        // Endpoints are tried one by one, each with a freshly opened socket whose buffer sizes
+        // are set before SYN, so window scaling accounts for them
+        void connect(asio::ip::tcp::resolver::results_type::const_iterator endpoint) {
+            auto &socket = _connection.socket();
+            system::error_code ec;
+            socket.close(ec);
+            if (endpoint == _endpoints.end()) {
+                std::cerr << "[Client] Can't connect to Server" << std::endl;
+                _connection.close();
+                return;
+            }
+
+            socket.open(endpoint->endpoint().protocol(), ec);
+            if (ec) {
+                connect(std::next(endpoint));
+                return;
+            }
+            applyBufferSizes(socket, _tuning);
+            socket.async_connect(*endpoint, [this, endpoint](system::error_code ec) {
+                if (ec) {
+                    connect(std::next(endpoint));
+                    return;
+                }
+                std::clog << "[Client] Connected to Server!\n";
+                _connection.tune(_tuning);
+                if (_connection.tls())
+                    _connection.handshake(asio::ssl::stream_base::client,
+                                          [this]() { _connection.readHeader(); });
+                else
+                    _connection.readHeader();
+            });
+        }
+
         asio::io_context _io_context;
         asio::ip::tcp::resolver::results_type _endpoints;
         std::thread _context_thread;
+        SocketTuning _tuning;
+        std::optional<asio::ssl::context> _tls_context;
         Connection _connection;
         filesystem::directory_entry _root_dir;
+        std::atomic<size_t> _files_in_flight{0};
+        std::atomic<size_t> _queries_in_flight{0};
+        std::atomic<size_t> _failed_files{0};
+        std::map<std::string, boost::filesystem::path> _queried_files;
     };
 }
 
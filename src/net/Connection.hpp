@@ -5,10 +5,28 @@
 
 #include "../pch.h"
 #include "ts_deque.hpp"
+#include "Tls.hpp"
+#include "Limits.hpp"
+#include "SocketTuning.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
 
 namespace net {
     using namespace boost;
 
+#ifdef __linux__
+    // Part of a file whose bytes go to the socket straight from the page cache
+    struct FileSlice {
+        std::shared_ptr<const int> fd;
+        off_t offset;
+        size_t length;
+    };
+#endif
+
     class Connection :
             public std::enable_shared_from_this<Connection> {
     public:
@@ -16,17 +34,147 @@ namespace net {
                 _socket(std::move(socket)), _io_context(io_context) {
         }
 
+        ~Connection() {
+            // Handshake may never have finished
+            _tls_secrets.wipe();
+            if (_budget)
+                _budget->release(bufferedBytes());
+        }
+
         bool connected() const {
             return _socket.is_open();
         }
 
+        /// @brief Reading stops while queued messages take more than quota bytes or budget is exceeded
+        /// @details Must be called before reading starts
+        void setQuota(size_t quota, MemoryBudget *budget = nullptr) {
+            _quota = quota;
+            _budget = budget;
+        }
+
+        /// @brief Applies socket options, call once the socket is connected
+        /// @details Buffer sizes have to be applied before connecting, see applyBufferSizes()
+        void tune(const SocketTuning &tuning) {
+            _tuning = tuning;
+            applyTuning(_socket, _tuning);
+        }
+
+        [[nodiscard]] size_t bufferedBytes() const {
+            return _incoming_bytes + _outgoing_bytes;
+        }
+
+        /// @brief Bytes of received messages not handled yet
+        [[nodiscard]] size_t incomingBytes() const {
+            return _incoming_bytes;
+        }
+
+        /// @brief Bytes of messages not sent yet, growing while the peer doesn't read
+        [[nodiscard]] size_t outgoingBytes() const {
+            return _outgoing_bytes;
+        }
+
+        [[nodiscard]] std::chrono::steady_clock::duration receivedIdleFor() const {
+            return std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point{
+                    std::chrono::steady_clock::duration{_last_received}};
+        }
+
+        [[nodiscard]] std::chrono::steady_clock::duration sentIdleFor() const {
+            return std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point{
+                    std::chrono::steady_clock::duration{_last_sent}};
+        }
+
+        /// @brief Restarts reading paused by quota once there is room again
+        /// @details Asynchronous function
+        void resumeReads() {
+            if (!_reads_paused)
+                return;
+            asio::post(_io_context, [this, self = keepAlive()]() {
+                if (_reads_paused && !overQuota(true) && _socket.is_open()) {
+                    std::clog << "[Connection] Reads resumed.\n";
+                    _reads_paused = false;
+                    readHeader();
+                }
+            });
+        }
+
+        /// @brief Wraps the socket into TLS stream, nothing is sent until handshake() is done
+        /// @param kernel_offload hand encryption of outgoing data to kernel TLS when possible
+        void enableTls(asio::ssl::context &context, bool kernel_offload = true) {
+            _tls_stream = std::make_unique<asio::ssl::stream<asio::ip::tcp::socket &>>(_socket, context);
+            SSL_set_ex_data(_tls_stream->native_handle(), tlsSecretsIndex(), &_tls_secrets);
+            _kernel_tls_offload = kernel_offload;
+            _ready = false;
+        }
+
+        /// @brief Server certificate must be issued for host, call after enableTls() and before handshake()
+        bool verifyPeerName(const std::string &host) {
+            if (setTlsPeerName(_tls_stream->native_handle(), host))
+                return true;
+            std::clog << "[Connection] Can't set TLS peer name " << host << ".\n";
+            return false;
+        }
+
+        [[nodiscard]] bool readsPaused() const {
+            return _reads_paused;
+        }
+
+        bool tls() const {
+            return _tls_stream != nullptr;
+        }
+
+        bool kernelTls() const {
+            return _kernel_tls_tx;
+        }
+
+        /// @details Asynchronous function
+        void handshake(asio::ssl::stream_base::handshake_type type,
+                       std::function<void()> onReady = nullptr) {
+            _tls_stream->async_handshake(
+                    type,
+                    [this, self = keepAlive(), type, onReady = std::move(onReady)](system::error_code ec) {
+                        if (!ec) {
+                            std::clog << "[Connection] TLS Handshake Done.\n";
+                            if (_kernel_tls_offload) {
+                                _kernel_tls_tx = enableKernelTlsTx(_tls_stream->native_handle(),
+                                                                   _socket.native_handle(), _tls_secrets,
+                                                                   type == asio::ssl::stream_base::server);
+                                std::clog << "[Connection] Kernel TLS "
+                                          << (_kernel_tls_tx ? "enabled" : "unavailable, using OpenSSL")
+                                          << ".\n";
+                            }
+                            // Secrets aren't needed any more
+                            _tls_secrets.wipe();
+
+                            _ready = true;
+                            if (!_msg_queue_out.empty())
+                                writeHeader();
+                            if (onReady)
+                                onReady();
+                        } else {
+                            std::clog << "[Connection] TLS Handshake Fail: " << ec.message() << "\n";
+                            closeSocket();
+                        }
+                    });
+        }
+
         /// @details Asynchronous function
         void disconnect() {
             if (_socket.is_open()) {
-                asio::post(_io_context, [this]() { _socket.close(); });
+                asio::post(_io_context, [this, self = keepAlive()]() {
+                    if (_socket.is_open())
+                        closeSocket();
+                });
             }
         }
 
+        /// @brief Closes the socket right away, so popIncoming() returns nullopt after queued messages
+        /// @details For owners of already stopped io_context, otherwise see disconnect()
+        void close() {
+            // Handler of the pending read won't run to queue the end of messages
+            _read_pending = false;
+            closeSocket();
+        }
+
         asio::ip::tcp::socket &socket() {
             return _socket;
         }
@@ -34,11 +182,14 @@ namespace net {
         /// @details Asynchronous function
         void sendMsg(const Message &msg) {
             asio::post(_io_context,
-                       [this, msg]() {
-
+                       [this, self = keepAlive(), msg]() {
+                           // Nothing can be sent after the connection was closed
+                           if (_closed)
+                               return;
                            bool writeInProcess = !_msg_queue_out.empty();
+                           charge(_outgoing_bytes, footprint(msg));
                            _msg_queue_out.push_back(msg);
-                           if (!writeInProcess)
+                           if (!writeInProcess && _ready)
                                writeHeader();
                        });
         }
@@ -46,21 +197,26 @@ namespace net {
         /// @details Asynchronous function
         void sendMsg(Message &&msg) {
             asio::post(_io_context,
-                       [this, msg]() {
+                       [this, self = keepAlive(), msg]() {
+                           // Nothing can be sent after the connection was closed
+                           if (_closed)
+                               return;
                            bool writeInProcess = !_msg_queue_out.empty();
+                           charge(_outgoing_bytes, footprint(msg));
                            _msg_queue_out.push_back(msg);
-                           if (!writeInProcess)
+                           if (!writeInProcess && _ready)
                                writeHeader();
                        });
         }
 
-        void sendFile(const boost::filesystem::path &path) {
+        bool sendFile(const boost::filesystem::path &path) {
             if (!exists(path)) {
                 std::cerr << "[Connection] File is not found" << std::endl;
-                return;
+                return false;
             }
 
             writeFileHeader(path.string());
+            return true;
         }
 
         void writeFileHeader(const boost::filesystem::path &path) {
@@ -73,8 +229,48 @@ namespace net {
             writeFileBody(path);
         }
 
+#ifdef __linux__
+        void writeFileBody(const boost::filesystem::path &path) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                std::cerr << "[Connection] File cannot be opened." << std::endl;
+                return;
+            }
+
+            std::shared_ptr<const int> file{new int{fd}, [](const int *fd) {
+                ::close(*fd);
+                delete fd;
+            }};
+            auto file_size = boost::filesystem::file_size(path);
+
+            // Receiver waits for file_size bytes, empty file is sent as one empty message
+            asio::post(_io_context,
+                       [this, self = keepAlive(), file, file_size]() {
+                           if (_closed)
+                               return;
+                           bool writeInProcess = !_msg_queue_out.empty();
+                           uintmax_t offset = 0;
+                           do {
+                               auto length = std::min<uintmax_t>(FILE_CHUNK_SIZE, file_size - offset);
+                               // Bodies stay in the page cache, only headers are queued
+                               charge(_outgoing_bytes, HEADER_SIZE);
+                               if (length == 0) {
+                                   _msg_queue_out.push_back(Message{Message::MessageHeader{MsgType::FileTransfer}});
+                                   break;
+                               }
+                               _msg_queue_out.push_back(
+                                       Message{Message::MessageHeader{MsgType::FileTransfer, length}});
+                               _file_slices_out.push_back(
+                                       FileSlice{file, static_cast<off_t>(offset), static_cast<size_t>(length)});
+                               offset += length;
+                           } while (offset < file_size);
+                           if (!writeInProcess && _ready)
+                               writeHeader();
+                       });
+        }
+#else
         void writeFileBody(const boost::filesystem::path &path) {
-            std::ifstream ifs{path.string()};
+            std::ifstream ifs{path.string(), std::ios::binary};
 
             if (!ifs.is_open()) {
                 std::cerr << "[Connection] File cannot be opened." << std::endl;
@@ -82,98 +278,197 @@ namespace net {
             }
 
             std::string buffer;
-            buffer.resize(MAX_BODY_SIZE);
-            Message msg{Message::MessageHeader{MsgType::FileTransfer, MAX_BODY_SIZE}};
-
-            while (ifs) {
-                ifs.read(buffer.data(), MAX_BODY_SIZE);
-                msg.body() = buffer;
-                std::fill(buffer.begin(), buffer.end(), '\0');
-                sendMsg(msg);
-            }
+            buffer.resize(FILE_CHUNK_SIZE);
+            auto file_size = boost::filesystem::file_size(path);
+
+            // Receiver waits for file_size bytes, empty file is sent as one empty message
+            uintmax_t offset = 0;
+            size_t length;
+            do {
+                ifs.read(buffer.data(), static_cast<std::streamsize>(std::min<uintmax_t>(FILE_CHUNK_SIZE,
+                                                                                         file_size - offset)));
+                length = static_cast<size_t>(ifs.gcount());
+                sendMsg(Message{Message::MessageHeader{MsgType::FileTransfer}, buffer.substr(0, length)});
+                offset += length;
+            } while (ifs && length > 0 && offset < file_size);
         }
+#endif
 
         /// @details Asynchronous function
         void readHeader() {
-            asio::async_read(_socket,
-                             asio::buffer(&_tempMsgIn.header(), net::HEADER_SIZE),
-                             [this](system::error_code ec, std::size_t length) {
+            _read_pending = true;
+            asyncRead(asio::buffer(&_tempMsgIn.header(), net::HEADER_SIZE),
+                             [this, self = keepAlive()](system::error_code ec, std::size_t length) {
+                                 _read_pending = false;
                                  if (!ec) {
                                      std::clog << "[Connection] Read Header Done.\n";
-                                     if (_tempMsgIn.bodyLength() > 0) {
+                                     touch(_last_received);
+                                     if (_tuning.quick_ack)
+                                         rearmQuickAck(_socket);
+                                     if (!isWireType(_tempMsgIn.header().msgType())) {
+                                         std::clog << "[Connection] Unexpected message type.\n";
+                                         closeSocket();
+                                     } else if (_tempMsgIn.bodyLength() > _quota) {
+                                         std::clog << "[Connection] Message exceeds quota.\n";
+                                         closeSocket();
+                                     } else if (_budget && !_budget->covers(HEADER_SIZE + _tempMsgIn.bodyLength())) {
+                                         std::clog << "[Connection] Message exceeds memory budget.\n";
+                                         closeSocket();
+                                     } else if (_tempMsgIn.bodyLength() > 0) {
+                                         // Body buffer counts as received before it's filled
+                                         _body_in_flight = HEADER_SIZE + _tempMsgIn.bodyLength();
+                                         charge(_incoming_bytes, _body_in_flight);
                                          _tempMsgIn.resize(_tempMsgIn.bodyLength());
                                          readBody();
                                      } else {
-                                         _msg_queue_in.push_back(_tempMsgIn);
-                                         readHeader();
+                                         _tempMsgIn.resize(0);
+                                         pushIncoming(_tempMsgIn);
+                                         readNext();
                                      }
                                  } else {
                                      std::clog << "[Connection] Read Header Fail.\n";
-                                     _socket.close();
+                                     closeSocket();
                                  }
                              });
         }
 
         /// @details Asynchronous function
         void readBody() {
-            asio::async_read(_socket,
-                             asio::buffer(_tempMsgIn.data(), _tempMsgIn.bodyLength()),
-                             [this](system::error_code ec, std::size_t length) {
+            _read_pending = true;
+            asyncRead(asio::buffer(_tempMsgIn.data(), _tempMsgIn.bodyLength()),
+                             [this, self = keepAlive()](system::error_code ec, std::size_t length) {
+                                 _read_pending = false;
+                                 release(_incoming_bytes, _body_in_flight);
+                                 _body_in_flight = 0;
                                  if (!ec) {
                                      std::clog << "[Connection] Read Body Done.\n";
-                                     _msg_queue_in.push_back(_tempMsgIn);
-                                     readHeader();
+                                     touch(_last_received);
+                                     if (_tuning.quick_ack)
+                                         rearmQuickAck(_socket);
+                                     pushIncoming(_tempMsgIn);
+                                     // Queued copy is charged instead, the buffer is allocated again for the next body
+                                     std::string{}.swap(_tempMsgIn.body());
+                                     readNext();
                                  } else {
                                      std::clog << "[Connection] Read Body Fail.\n";
-                                     _socket.close();
+                                     closeSocket();
                                  }
                              });
         }
 
         /// @details Asynchronous function
         void writeHeader() {
-            asio::async_write(_socket,
-                              asio::buffer(&_msg_queue_out.front().header(),
-                                           net::HEADER_SIZE),
-                              [this](system::error_code ec, std::size_t length) {
+            if (_tuning.cork_file_transfers && !_corked) {
+                auto type = _msg_queue_out.front().header().msgType();
+                if (type == MsgType::FileHeader || type == MsgType::FileTransfer) {
+                    setCork(_socket, true);
+                    _corked = true;
+                }
+            }
+            asyncWrite(asio::buffer(&_msg_queue_out.front().header(), net::HEADER_SIZE),
+                              [this, self = keepAlive()](system::error_code ec, std::size_t length) {
                                   if (!ec) {
 //                                      std::clog << "[Connection] Write Header Done.\n";
                                       std::clog << "[Connection] Write Header Done"
                                                 << " with length = " << length << ".\n";
+                                      touch(_last_sent);
                                       if (_msg_queue_out.front().bodyLength() > 0) {
+#ifdef __linux__
+                                          if (_msg_queue_out.front().body().empty() &&
+                                              !_file_slices_out.empty()) {
+                                              writeFileSlice();
+                                              return;
+                                          }
+#endif
                                           writeBody();
                                       } else {
-                                          _msg_queue_out.pop_front();
+                                          popOutgoing();
                                           if (!_msg_queue_out.empty())
                                               writeHeader();
                                       }
                                   } else {
                                       std::clog << "[Connection] Write Header Fail.\n";
-                                      _socket.close();
+                                      closeSocket();
                                   }
                               });
         }
 
         /// @details Asynchronous function
         void writeBody() {
-            asio::async_write(_socket,
-                              asio::buffer(_msg_queue_out.front().data(),
-                                           _msg_queue_out.front().bodyLength()),
-                              [this](system::error_code ec, std::size_t length) {
+            asyncWrite(asio::buffer(_msg_queue_out.front().data(),
+                                    _msg_queue_out.front().bodyLength()),
+                              [this, self = keepAlive()](system::error_code ec, std::size_t length) {
                                   if (!ec) {
 //                                      std::clog << "[Connection] Write Body Done.\n";
                                       std::clog << "[Connection] Write Body Done"
                                                 << " with length = " << length << ".\n";
-                                      _msg_queue_out.pop_front();
+                                      touch(_last_sent);
+                                      popOutgoing();
                                       if (!_msg_queue_out.empty())
                                           writeHeader();
                                   } else {
                                       std::clog << "[Connection] Write Body Fail.\n";
-                                      _socket.close();
+                                      closeSocket();
                                   }
                               });
         }
 
+#ifdef __linux__
+        /// @details Asynchronous function
+        /// @details Sends body of the front message from its file slice.
+        /// Goes through sendfile(2) unless data has to be encrypted by OpenSSL.
+        void writeFileSlice() {
+            auto &slice = _file_slices_out.front();
+
+            if (_tls_stream && !_kernel_tls_tx) {
+                auto msg = _msg_queue_out.pop_front();
+                msg.resize(slice.length);
+                auto length = ::pread(*slice.fd, msg.data(), slice.length, slice.offset);
+                _file_slices_out.pop_front();
+                charge(_outgoing_bytes, msg.body().size());
+                _msg_queue_out.push_front(msg);
+                if (length != static_cast<ssize_t>(msg.bodyLength())) {
+                    std::clog << "[Connection] Read File Slice Fail.\n";
+                    closeSocket();
+                    return;
+                }
+                writeBody();
+                return;
+            }
+
+            _socket.native_non_blocking(true);
+            while (slice.length > 0) {
+                auto sent = ::sendfile(_socket.native_handle(), *slice.fd, &slice.offset, slice.length);
+                if (sent > 0) {
+                    slice.length -= sent;
+                    touch(_last_sent);
+                } else if (sent < 0 && errno == EINTR) {
+                    continue;
+                } else if (sent < 0 && errno == EAGAIN) {
+                    _socket.async_wait(asio::ip::tcp::socket::wait_write,
+                                       [this, self = keepAlive()](system::error_code ec) {
+                                           if (!ec) {
+                                               writeFileSlice();
+                                           } else {
+                                               std::clog << "[Connection] Write File Slice Fail.\n";
+                                               closeSocket();
+                                           }
+                                       });
+                    return;
+                } else {
+                    std::clog << "[Connection] Write File Slice Fail.\n";
+                    closeSocket();
+                    return;
+                }
+            }
+
+            _file_slices_out.pop_front();
+            popOutgoing();
+            if (!_msg_queue_out.empty())
+                writeHeader();
+        }
+#endif
+
         void setOnMessageHandler(std::function<void(const Message &)> onMessageHandler) {
             _onMessageHandler = std::move(onMessageHandler);
         }
@@ -182,29 +477,153 @@ namespace net {
             _onMessageHandler = nullptr;
         }
 
-        [[noreturn]] void processIncoming() {
-//            _connections.wait();
+        /// @details Returns once the socket is closed and all received messages are handled
+        void processIncoming() {
+            while (auto msg = popIncoming()) {
+                if (_onMessageHandler) {
+                    _onMessageHandler(*msg);
+                } else
+                    std::clog << "[Connection] Got no handler" << std::endl;
+            }
+        }
+
+        /// @brief Blocks until a message is received
+        /// @returns nullopt once the socket is closed and all received messages are popped
+        std::optional<Message> popIncoming() {
             _msg_queue_in.wait();
-            while (true)
-//                if (!_connections.back()->incoming().empty()) {
-                if (!_msg_queue_in.empty()) {
-//                    auto msg = _connections.back()->incoming().pop_front();
-                    auto msg = _msg_queue_in.pop_front();
-
-                    if (_onMessageHandler) {
-                        _onMessageHandler(msg);
-                    } else
-                        std::clog << "[Connection] Got no handler" << std::endl;
-                }
+            auto msg = _msg_queue_in.pop_front();
+            if (!msg) {
+                // Stays queued for later calls
+                _msg_queue_in.push_front(msg);
+                return msg;
+            }
+            release(_incoming_bytes, footprint(*msg));
+            resumeReads();
+            return msg;
         }
 
     private:
-        ts_deque<Message> _msg_queue_in;
+        // Posted work and handlers hold the connection when it's owned by shared_ptr,
+        // otherwise the owner outlives io_context work by itself
+        std::shared_ptr<Connection> keepAlive() {
+            return weak_from_this().lock();
+        }
+
+        static size_t footprint(const Message &msg) {
+            return HEADER_SIZE + msg.body().size();
+        }
+
+        static void touch(std::atomic<std::chrono::steady_clock::rep> &timestamp) {
+            timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
+        }
+
+        void charge(std::atomic<size_t> &queue_bytes, size_t bytes) {
+            queue_bytes += bytes;
+            if (_budget)
+                _budget->charge(bytes);
+        }
+
+        void release(std::atomic<size_t> &queue_bytes, size_t bytes) {
+            queue_bytes -= bytes;
+            if (_budget)
+                _budget->release(bytes);
+        }
+
+        // Resuming needs half of the quota free, so reads don't flap around the limit
+        bool overQuota(bool resuming) const {
+            return bufferedBytes() > (resuming ? _quota / 2 : _quota) || (_budget && _budget->exceeded());
+        }
+
+        void pushIncoming(const Message &msg) {
+            charge(_incoming_bytes, footprint(msg));
+            _msg_queue_in.push_back(msg);
+        }
+
+        void popOutgoing() {
+            release(_outgoing_bytes, footprint(_msg_queue_out.pop_front()));
+            // Nothing more to coalesce with, the last partial segment goes out now
+            if (_corked && _msg_queue_out.empty()) {
+                setCork(_socket, false);
+                _corked = false;
+            }
+            resumeReads();
+        }
+
+        /// @details Asynchronous function
+        void readNext() {
+            // Paused flag is raised before the check, so a concurrent release can't miss it
+            _reads_paused = true;
+            if (overQuota(false)) {
+                if (_budget && _budget->exceeded())
+                    _budget->pressure(true);
+                std::clog << "[Connection] Reads paused, " << _incoming_bytes << " bytes received and "
+                          << _outgoing_bytes << " bytes to send queued.\n";
+                return;
+            }
+            _reads_paused = false;
+            readHeader();
+        }
+
+        // End of incoming messages is queued right away unless a pending read will fail and queue it
+        void closeSocket() {
+            system::error_code ec;
+            _socket.close(ec);
+            _closed = true;
+            if (!_read_pending && !_disconnected) {
+                _disconnected = true;
+                _msg_queue_in.push_back(std::nullopt);
+            }
+        }
+
+        template<typename MutableBuffers, typename Handler>
+        void asyncRead(const MutableBuffers &buffers, Handler &&handler) {
+            if (_tls_stream)
+                asio::async_read(*_tls_stream, buffers, std::forward<Handler>(handler));
+            else
+                asio::async_read(_socket, buffers, std::forward<Handler>(handler));
+        }
+
+        // With kernel TLS the socket encrypts outgoing data by itself
+        template<typename ConstBuffers, typename Handler>
+        void asyncWrite(const ConstBuffers &buffers, Handler &&handler) {
+            if (_tls_stream && !_kernel_tls_tx)
+                asio::async_write(*_tls_stream, buffers, std::forward<Handler>(handler));
+            else
+                asio::async_write(_socket, buffers, std::forward<Handler>(handler));
+        }
+
+        // nullopt marks the end of messages of the closed connection
+        ts_deque<std::optional<Message>> _msg_queue_in;
         ts_deque<Message> _msg_queue_out;
         Message _tempMsgIn;
         asio::ip::tcp::socket _socket;
+        std::unique_ptr<asio::ssl::stream<asio::ip::tcp::socket &>> _tls_stream;
+        TlsSecrets _tls_secrets;
+        bool _kernel_tls_offload{false};
+        bool _kernel_tls_tx{false};
+        // Outgoing messages are held back until TLS handshake is done
+        bool _ready{true};
+#ifdef __linux__
+        std::deque<FileSlice> _file_slices_out;
+#endif
         asio::io_context &_io_context;
         std::function<void(const Message &)> _onMessageHandler;
+        SocketTuning _tuning;
+        bool _corked{false};
+        size_t _quota{DEFAULT_CONNECTION_QUOTA};
+        MemoryBudget *_budget{nullptr};
+        std::atomic<size_t> _incoming_bytes{0};
+        std::atomic<size_t> _outgoing_bytes{0};
+        // Part of incoming bytes taken by the body being read
+        size_t _body_in_flight{0};
+        std::atomic<bool> _reads_paused{false};
+        bool _read_pending{false};
+        bool _closed{false};
+        bool _disconnected{false};
+        std::atomic<std::chrono::steady_clock::rep> _last_received{
+                std::chrono::steady_clock::now().time_since_epoch().count()};
+        std::atomic<std::chrono::steady_clock::rep> _last_sent{
+                std::chrono::steady_clock::now().time_since_epoch().count()};
     };
 }
 
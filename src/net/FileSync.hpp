@@ -0,0 +1,72 @@
+#ifndef NETWORKING_FILE_SYNC_HPP
+#define NETWORKING_FILE_SYNC_HPP
+
+#include "../pch.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Flushing of written files and renames to disk
+
+namespace net {
+    using namespace boost;
+
+    /// @returns file descriptor or -1
+    inline int openForSync(const filesystem::path &path) {
+#ifdef _WIN32
+        return ::_wopen(path.c_str(), _O_WRONLY | _O_BINARY);
+#else
+        return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+    }
+
+    inline bool syncData(int fd) {
+#ifdef _WIN32
+        return ::_commit(fd) == 0;
+#elif defined(__APPLE__)
+        return ::fsync(fd) == 0;
+#else
+        return ::fdatasync(fd) == 0;
+#endif
+    }
+
+    inline void closeFile(int fd) {
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+    }
+
+    /// @brief Flushes content of the closed file
+    inline bool syncFile(const filesystem::path &path) {
+        int fd = openForSync(path);
+        if (fd < 0)
+            return false;
+        bool synced = syncData(fd);
+        closeFile(fd);
+        return synced;
+    }
+
+    /// @brief Makes renames into directory durable
+    inline bool syncDirectory(const filesystem::path &directory) {
+#ifdef _WIN32
+        // NTFS journals renames by itself, directories can't be opened for sync
+        return true;
+#else
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        bool synced = ::fsync(fd) == 0;
+        ::close(fd);
+        return synced;
+#endif
+    }
+}
+
+#endif //NETWORKING_FILE_SYNC_HPP
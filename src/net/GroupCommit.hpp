@@ -0,0 +1,145 @@
+#ifndef NETWORKING_GROUP_COMMIT_HPP
+#define NETWORKING_GROUP_COMMIT_HPP
+
+#include "../pch.h"
+#include "FileSync.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+// Makes received files durable and publishes them under their final names.
+// Files that complete while a batch is being synced are committed together in the next batch,
+// so the cost of waiting for the disk is shared between them instead of paid per file.
+
+namespace net {
+    using namespace boost;
+
+    enum class CommitStatus {
+        Committed,
+        // Renamed to target, but the rename may be lost on crash because its directory couldn't be synced
+        NotDurable,
+        // Target is untouched, temporary file is removed
+        Failed
+    };
+
+    class GroupCommit {
+    public:
+        // Called from the commit thread
+        using Callback = std::function<void(CommitStatus status)>;
+
+        GroupCommit() :
+                _commit_thread([this]() { run(); }) {
+        }
+
+        GroupCommit(const GroupCommit &) = delete;
+
+        ~GroupCommit() {
+            {
+                std::scoped_lock lock(_mutex);
+                _stopped = true;
+            }
+            _cv.notify_one();
+            _commit_thread.join();
+        }
+
+        /// @brief Syncs completely written temporary file and renames it to target
+        /// @details Asynchronous function
+        void commit(filesystem::path temporary, filesystem::path target, Callback onCommitted) {
+            {
+                std::scoped_lock lock(_mutex);
+                _pending.push_back(Entry{std::move(temporary), std::move(target), std::move(onCommitted)});
+            }
+            _cv.notify_one();
+        }
+
+    private:
+        struct Entry {
+            filesystem::path temporary;
+            filesystem::path target;
+            Callback onCommitted;
+        };
+
+        void run() {
+            std::vector<Entry> batch;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> ul(_mutex);
+                    _cv.wait(ul, [this]() { return _stopped || !_pending.empty(); });
+                    // Pending files are still committed on stop
+                    if (_pending.empty())
+                        return;
+                    batch.swap(_pending);
+                }
+                commitBatch(batch);
+                batch.clear();
+            }
+        }
+
+        void commitBatch(std::vector<Entry> &batch) {
+            std::vector<int> fds;
+            fds.reserve(batch.size());
+            for (auto &entry: batch) {
+                fds.push_back(openForSync(entry.temporary));
+#ifdef __linux__
+                // Start writeback of every file first, so their disk writes overlap
+                if (fds.back() >= 0)
+                    ::sync_file_range(fds.back(), 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+            }
+
+            std::vector<CommitStatus> status(batch.size(), CommitStatus::Failed);
+            std::set<filesystem::path> directories;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (fds[i] < 0) {
+                    std::cerr << "[GroupCommit] Can't open " << batch[i].temporary << std::endl;
+                    continue;
+                }
+                bool synced = syncData(fds[i]);
+                closeFile(fds[i]);
+                if (!synced) {
+                    std::cerr << "[GroupCommit] Can't sync " << batch[i].temporary << std::endl;
+                    continue;
+                }
+
+                system::error_code ec;
+                filesystem::rename(batch[i].temporary, batch[i].target, ec);
+                if (ec) {
+                    std::cerr << "[GroupCommit] Can't rename " << batch[i].temporary
+                              << ": " << ec.message() << std::endl;
+                    continue;
+                }
+                directories.insert(batch[i].target.parent_path());
+                status[i] = CommitStatus::Committed;
+            }
+
+            // Renames are durable once their directories are synced, once per batch.
+            // Renamed files can't be taken back, so they are only reported as not durable
+            for (const auto &directory: directories)
+                if (!syncDirectory(directory)) {
+                    std::cerr << "[GroupCommit] Can't sync directory " << directory
+                              << ", its renames aren't durable" << std::endl;
+                    for (size_t i = 0; i < batch.size(); ++i)
+                        if (status[i] == CommitStatus::Committed && batch[i].target.parent_path() == directory)
+                            status[i] = CommitStatus::NotDurable;
+                }
+
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (status[i] == CommitStatus::Failed) {
+                    system::error_code ec;
+                    filesystem::remove(batch[i].temporary, ec);
+                }
+                if (batch[i].onCommitted)
+                    batch[i].onCommitted(status[i]);
+            }
+        }
+
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::vector<Entry> _pending;
+        bool _stopped{false};
+        std::thread _commit_thread;
+    };
+}
+
+#endif //NETWORKING_GROUP_COMMIT_HPP
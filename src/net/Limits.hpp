@@ -0,0 +1,75 @@
+#ifndef NETWORKING_LIMITS_HPP
+#define NETWORKING_LIMITS_HPP
+
+#include "../pch.h"
+
+namespace net {
+    // Bytes of queued messages after which a connection stops reading
+    constexpr size_t DEFAULT_CONNECTION_QUOTA{8 << 20};
+
+    struct Limits {
+        // Per connection, applies to incoming and outgoing queues together
+        size_t connection_quota{DEFAULT_CONNECTION_QUOTA};
+        // All connections of Server together
+        size_t memory_budget{256 << 20};
+        // New connections are refused once this share of the budget is used
+        double admission_threshold{0.9};
+        size_t max_connections{1024};
+        // Server sends Heartbeat when it hasn't sent anything for this long
+        std::chrono::seconds heartbeat_interval{15};
+        // Connection is closed when nothing has been received for this long
+        std::chrono::seconds idle_timeout{60};
+    };
+
+    // Memory of queued messages shared between connections
+    class MemoryBudget {
+    public:
+        explicit MemoryBudget(size_t limit, double admission_threshold = 1.0) :
+                _limit(limit),
+                _admission_limit(static_cast<size_t>(static_cast<double>(limit) * admission_threshold)) {
+        }
+
+        MemoryBudget(const MemoryBudget &) = delete;
+
+        void charge(size_t bytes) {
+            _used += bytes;
+        }
+
+        void release(size_t bytes) {
+            _used -= bytes;
+        }
+
+        [[nodiscard]] size_t used() const {
+            return _used;
+        }
+
+        [[nodiscard]] bool exceeded() const {
+            return _used > _limit;
+        }
+
+        [[nodiscard]] bool covers(size_t bytes) const {
+            return bytes <= _limit && _used <= _limit - bytes;
+        }
+
+        [[nodiscard]] bool admits() const {
+            return _used < _admission_limit;
+        }
+
+        // Set when some connection paused its reads because the budget was exceeded
+        void pressure(bool pressure) {
+            _pressure = pressure;
+        }
+
+        [[nodiscard]] bool pressure() const {
+            return _pressure;
+        }
+
+    private:
+        std::atomic<size_t> _used{0};
+        std::atomic<bool> _pressure{false};
+        size_t _limit;
+        size_t _admission_limit;
+    };
+}
+
+#endif //NETWORKING_LIMITS_HPP
@@ -31,7 +31,13 @@ namespace net {
         EmptyMessage,
         FileHeader,
         FileTransfer,
-        Disconnection
+        // Never sent, kept so values of later types don't change
+        Disconnection,
+        FileCommitted,
+        CatalogQuery,
+        CatalogReply,
+        Heartbeat,
+        FileCommitFailed
     };
 
     constexpr const char *to_string(MsgType msgType) {
@@ -44,9 +50,28 @@ namespace net {
                 return "FileHeader";
             case MsgType::FileTransfer:
                 return "FileTransfer";
+            case MsgType::Disconnection:
+                return "Disconnection";
+            case MsgType::FileCommitted:
+                return "FileCommitted";
+            case MsgType::CatalogQuery:
+                return "CatalogQuery";
+            case MsgType::CatalogReply:
+                return "CatalogReply";
+            case MsgType::Heartbeat:
+                return "Heartbeat";
+            case MsgType::FileCommitFailed:
+                return "FileCommitFailed";
         }
     }
 
+    // Header read from the socket is valid only with one of these types
+    constexpr bool isWireType(MsgType msgType) {
+        return msgType != MsgType::Disconnection &&
+               static_cast<int>(msgType) >= static_cast<int>(MsgType::PlainText) &&
+               static_cast<int>(msgType) <= static_cast<int>(MsgType::FileCommitFailed);
+    }
+
     class Message {
     public:
         using bodyLength_type = size_t;
@@ -170,6 +195,9 @@ namespace net {
 
     constexpr size_t HEADER_SIZE{sizeof(Message::MessageHeader)};
     constexpr size_t MAX_BODY_SIZE{1024 - HEADER_SIZE};
+    // File content is sent in FileTransfer messages of up to this size, each moved by one long sendfile(2).
+    // Must stay below receiver's connection quota
+    constexpr size_t FILE_CHUNK_SIZE{1 << 20};
 }
 
 #endif //NETWORKING_MESSAGE_HPP
\ No newline at end of file
@@ -4,23 +4,41 @@
 #include "../pch.h"
 #include "Message.hpp"
 #include "Connection.hpp"
+#include "GroupCommit.hpp"
+#include "Catalog.hpp"
+#include "Limits.hpp"
+#include "TimerWheel.hpp"
+#include "SocketTuning.hpp"
 
 namespace net {
     using namespace boost;
 
     class Server {
     public:
-        explicit Server(const uint16_t port) :
+        explicit Server(const uint16_t port, Limits limits = {}, SocketTuning tuning = {}) :
+                _limits(limits),
+                _budget{limits.memory_budget, limits.admission_threshold},
                 _endpoint{asio::ip::tcp::v4(), port},
-                _acceptor{_io_context, _endpoint} {
+                _acceptor{_io_context, _endpoint},
+                _tuning(tuning),
+                _timer_wheel{_io_context, std::chrono::milliseconds{100}, 512} {
 
             buffer.resize(MAX_BODY_SIZE);
+            applyTuning(_acceptor, _tuning);
         }
 
+        /// @details Must not be called while mainLoop() is running
         virtual ~Server() {
             _io_context.stop();
             if (_context_thread.joinable())
                 _context_thread.join();
+
+            // Handler threads use this Server, closing their connections lets them return
+            for (auto &[connection, thread]: _connections) {
+                connection->close();
+                thread.join();
+            }
+            _connections.clear();
             std::cout << "[Server] Stopped!\n";
         }
 
@@ -28,35 +46,53 @@ namespace net {
         void mainLoop() {
             _io_context.run();
 //            _context_thread = std::thread([this]() { _io_context.run(); });
-            _connection->processIncoming();
         }
 
         void Start() {
             waitForClients();
+            _timer_wheel.everyTick([this]() { resumeConnections(); });
+            _timer_wheel.start();
 
             std::cout << "[Server] Started!\n";
         }
 
+        /// @brief Makes mainLoop() return, connections are closed once Server is destroyed
+        void Stop() {
+            _io_context.stop();
+        }
+
         void waitForClients() {
             _acceptor.async_accept(
                     [this](boost::system::error_code ec, asio::ip::tcp::socket socket) {
                         if (!ec) {
-                            std::cout << "[Server] New Connection: " << socket.remote_endpoint() << "\n";
-                            _connection = std::make_unique<Connection>(std::move(socket), _io_context);
-                            _connection->setOnMessageHandler(
-                                    [this](const Message &message) { msgHandler(message); });
-                            _connection->readHeader();
-//                            _connection->processIncoming();
-//                            _connections.push_back(std::make_shared<Connection>(std::move(socket), _io_context));
-//                            _connections.back()->readHeader();
+                            if (_connections.size() >= _limits.max_connections || !_budget.admits()) {
+                                std::clog << "[Server] Refused Connection: " << _connections.size()
+                                          << " connections, " << _budget.used() << " bytes queued\n";
+                                socket.close(ec);
+                            } else {
+                                std::cout << "[Server] New Connection: " << socket.remote_endpoint(ec) << "\n";
+                                addConnection(std::move(socket));
+                            }
                         } else {
                             std::clog << "[Server] New Connection Error: " << ec.message() << "\n";
                         }
-//                        waitForClients();
+                        waitForClients();
                     });
         }
 
-        void msgHandler(const Message &msg) {
+        // State of the file being received over one connection
+        struct Upload {
+            bool in_progress = false;
+            // Temporary file is already removed, the rest of data is only counted
+            bool failed = false;
+            uintmax_t bytes_to_wait = 0;
+            std::ofstream ofs;
+            std::string file_name;
+            filesystem::path temporary_path;
+            Sha256 hash;
+        };
+
+        void msgHandler(Connection &connection, Upload &upload, const Message &msg) {
             std::clog << msg << std::endl;
 
             switch (msg.header().msgType()) {
@@ -65,34 +101,61 @@ namespace net {
                     auto pos = msg.body().rfind('\n');
                     if (pos == std::string::npos) {
                         std::cerr << "[Server] Corrupted File Header" << std::endl;
+                        connection.disconnect();
+                        break;
                     }
+                    abortUpload(upload);
 
-                    auto file_size = strtol(msg.body().c_str() + pos, nullptr, 10);
-                    packages_to_wait = file_size / MAX_BODY_SIZE + 1;
-                    std::string path{_root_dir.path().string() + "\\" +
-                                     msg.body().substr(0, pos)};
-
-                    ofs.open(path);
-                    if (!ofs.is_open()) {
-                        std::cerr << "[Server] Can't open ofstream" << std::endl;
+                    upload.bytes_to_wait = strtoull(msg.body().c_str() + pos, nullptr, 10);
+                    // File becomes visible under its name only after GroupCommit has synced it
+                    upload.file_name = msg.body().substr(0, pos);
+                    upload.in_progress = true;
+                    upload.failed = false;
+                    // Hidden names would replace catalog files, separators would escape the root
+                    if (!StorageCatalog::storable(upload.file_name)) {
+                        upload.temporary_path.clear();
+                        failUpload(upload, "name isn't allowed");
+                        break;
                     }
+                    upload.temporary_path = _root_dir.path() / filesystem::unique_path(".%%%%-%%%%-%%%%.part");
+
+                    upload.ofs.open(upload.temporary_path.string(), std::ios::binary);
+                    upload.hash.reset();
+                    if (!upload.ofs.is_open())
+                        failUpload(upload, "can't open temporary file");
 
                     break;
                 }
                 case MsgType::FileTransfer: {
                     std::clog << "[Server] Handling " << to_string(msg.header().msgType()) << std::endl;
-                    if (!ofs.is_open()) {
-                        std::cerr << "[Server] Ofstream isn't opened" << std::endl;
+                    if (!upload.in_progress) {
+                        std::cerr << "[Server] File data without File Header" << std::endl;
+                        break;
                     }
-                    ofs << msg.body();
-                    --packages_to_wait;
-                    if (packages_to_wait <= 0) {
-                        std::clog << "[Server] Whole file transfered" << std::endl;
-                        ofs.close();
+                    // Data of a failed upload is still received up to the declared size, then it's refused
+                    if (msg.body().size() > upload.bytes_to_wait) {
+                        failUpload(upload, "more data than declared");
+                        upload.bytes_to_wait = 0;
+                    } else {
+                        upload.bytes_to_wait -= msg.body().size();
+                        if (!upload.failed) {
+                            upload.ofs.write(msg.body().data(), static_cast<std::streamsize>(msg.body().size()));
+                            upload.hash.update(msg.body().data(), msg.body().size());
+                            if (!upload.ofs)
+                                failUpload(upload, "can't write temporary file");
+                        }
                     }
+                    if (upload.bytes_to_wait == 0)
+                        finishUpload(connection, upload);
 
                     break;
                 }
+                case MsgType::CatalogQuery: {
+                    std::clog << "[Server] Handling " << to_string(msg.header().msgType()) << std::endl;
+                    connection.sendMsg(Message{Message::MessageHeader{MsgType::CatalogReply},
+                                               _catalog.answer(msg.body())});
+                    break;
+                }
                 default: {
                     std::clog << "[Server] Handling " << to_string(msg.header().msgType()) << std::endl;
                     break;
@@ -100,27 +163,188 @@ namespace net {
             }
         }
 
+        // Unfinished file of the closed connection is never committed
+        static void abortUpload(Upload &upload) {
+            if (upload.in_progress && !upload.failed) {
+                std::clog << "[Server] Upload of " << upload.file_name << " interrupted" << std::endl;
+                upload.ofs.close();
+                system::error_code ec;
+                filesystem::remove(upload.temporary_path, ec);
+            }
+            upload.in_progress = false;
+        }
+
         const filesystem::directory_entry &root() {
             return _root_dir;
         }
 
         void root(const filesystem::path &root) {
             _root_dir.assign(root);
+            removeStaleParts();
+            _catalog.open(root);
+        }
+
+        /// @brief Accepted connections will use TLS, see makeServerTlsContext()
+        void enableTls(asio::ssl::context context) {
+            _tls_context.emplace(std::move(context));
         }
 
     private:
+        // Temporary files of uploads and catalog snapshots left by a crash are never committed
+        void removeStaleParts() {
+            system::error_code ec;
+            for (filesystem::directory_iterator it{_root_dir.path(), ec}, end; !ec && it != end; it.increment(ec)) {
+                auto name = it->path().filename().string();
+                if (!StorageCatalog::hidden(name) || it->path().extension() != ".part")
+                    continue;
+                std::clog << "[Server] Removing stale " << name << std::endl;
+                system::error_code remove_ec;
+                filesystem::remove(it->path(), remove_ec);
+            }
+        }
+
+        static void failUpload(Upload &upload, const char *reason) {
+            std::cerr << "[Server] Upload of " << upload.file_name << " failed: " << reason << std::endl;
+            upload.failed = true;
+            upload.ofs.close();
+            system::error_code ec;
+            filesystem::remove(upload.temporary_path, ec);
+        }
+
+        // Only a completely written and closed file is handed to GroupCommit
+        void finishUpload(Connection &connection, Upload &upload) {
+            std::clog << "[Server] Whole file transfered" << std::endl;
+            upload.in_progress = false;
+            if (!upload.failed) {
+                upload.ofs.close();
+                if (!upload.ofs)
+                    failUpload(upload, "can't close temporary file");
+            }
+            if (upload.failed) {
+                connection.sendMsg(Message{Message::MessageHeader{MsgType::FileCommitFailed}, upload.file_name});
+                return;
+            }
+
+            auto target = _root_dir.path() / upload.file_name;
+            _group_commit.commit(
+                    upload.temporary_path, target,
+                    [this, weak = connection.weak_from_this(), name = upload.file_name,
+                            target, hash = upload.hash.digest()](CommitStatus status) {
+                        // Not durable file isn't cataloged, so the client sends it again next time
+                        if (status != CommitStatus::Committed) {
+                            std::cerr << "[Server] Can't commit " << name
+                                      << (status == CommitStatus::NotDurable ? ", published but not durable"
+                                                                              : "") << std::endl;
+                            if (auto connection = weak.lock())
+                                connection->sendMsg(
+                                        Message{Message::MessageHeader{MsgType::FileCommitFailed}, name});
+                            return;
+                        }
+                        std::clog << "[Server] Committed " << name << std::endl;
+                        // Runs on the commit thread, where an exception would terminate
+                        system::error_code size_ec, mtime_ec;
+                        auto size = filesystem::file_size(target, size_ec);
+                        auto mtime = filesystem::last_write_time(target, mtime_ec);
+                        if (!size_ec && !mtime_ec)
+                            _catalog.update(name, CatalogEntry{size, mtime, hash});
+                        else
+                            std::cerr << "[Server] Can't catalog " << name << ": "
+                                      << (size_ec ? size_ec : mtime_ec).message() << std::endl;
+                        if (auto connection = weak.lock())
+                            connection->sendMsg(
+                                    Message{Message::MessageHeader{MsgType::FileCommitted}, name});
+                    });
+        }
+
+        void addConnection(asio::ip::tcp::socket socket) {
+            auto connection = std::make_shared<Connection>(std::move(socket), _io_context);
+            connection->setQuota(_limits.connection_quota, &_budget);
+            connection->tune(_tuning);
+
+            // Messages of each connection are handled by its own thread until the connection is closed
+            _connections.emplace(connection, std::thread([this, connection]() {
+                Upload upload;
+                connection->setOnMessageHandler(
+                        [this, &connection = *connection, &upload](const Message &message) {
+                            msgHandler(connection, upload, message);
+                        });
+                connection->processIncoming();
+                connection->resetOnMessageHandler();
+                abortUpload(upload);
+                asio::post(_io_context, [this, connection]() {
+                    auto it = _connections.find(connection);
+                    // The thread has nothing left to do but return
+                    it->second.join();
+                    _connections.erase(it);
+                    std::clog << "[Server] Connection closed, " << _connections.size() << " left\n";
+                });
+            }));
+
+            if (_tls_context) {
+                connection->enableTls(*_tls_context);
+                connection->handshake(asio::ssl::stream_base::server,
+                                      [connection = connection.get()]() { connection->readHeader(); });
+            } else {
+                connection->readHeader();
+            }
+            watchIdle(connection);
+        }
+
+        // Checked once per heartbeat interval, so idle timeout is precise up to that interval
+        void watchIdle(const std::weak_ptr<Connection> &weak) {
+            _timer_wheel.schedule(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(_limits.heartbeat_interval),
+                    [this, weak]() {
+                        auto connection = weak.lock();
+                        if (!connection || !connection->connected())
+                            return;
+
+                        // Silence caused by our own backlog of received messages doesn't count,
+                        // while reads paused by replies the peer doesn't read count from the last write
+                        std::chrono::steady_clock::duration idle{};
+                        if (!connection->readsPaused())
+                            idle = connection->receivedIdleFor();
+                        else if (connection->outgoingBytes() > connection->incomingBytes())
+                            idle = connection->sentIdleFor();
+                        if (idle >= _limits.idle_timeout) {
+                            std::clog << "[Server] Closing " << (connection->readsPaused() ? "stalled" : "idle")
+                                      << " connection\n";
+                            connection->disconnect();
+                            return;
+                        }
+                        if (connection->sentIdleFor() >= _limits.heartbeat_interval)
+                            connection->sendMsg(Message{Message::MessageHeader{MsgType::Heartbeat}});
+                        watchIdle(weak);
+                    });
+        }
+
+        // Connections paused by the shared budget aren't resumed by their own queues draining
+        void resumeConnections() {
+            if (!_budget.pressure() || _budget.exceeded())
+                return;
+            _budget.pressure(false);
+            for (const auto &[connection, thread]: _connections)
+                connection->resumeReads();
+        }
+
+        Limits _limits;
+        // Outlives io_context, whose unfinished handlers may still hold connections charged to it
+        MemoryBudget _budget;
         asio::io_context _io_context;
         asio::ip::tcp::endpoint _endpoint;
         asio::ip::tcp::acceptor _acceptor;
+        std::optional<asio::ssl::context> _tls_context;
         std::thread _context_thread;
-//        Connection _connection;
-        std::unique_ptr<Connection> _connection;
-//        ts_deque<std::shared_ptr<Connection>> _connections;
-        size_t packages_to_wait = 0;
-        std::ofstream ofs;
+        SocketTuning _tuning;
+        TimerWheel _timer_wheel;
+        // Connections with threads handling their messages
+        std::map<std::shared_ptr<Connection>, std::thread> _connections;
         std::string buffer;
         filesystem::directory_entry _root_dir;
+        StorageCatalog _catalog;
+        // Declared last, so pending commits are done while connections still exist
+        GroupCommit _group_commit;
     };
 }
 
-#endif //NETWORKING_SERVER_HPP
\ No newline at end of file
+#endif //NETWORKING_SERVER_HPP
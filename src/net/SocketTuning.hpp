@@ -0,0 +1,108 @@
+#ifndef NETWORKING_SOCKET_TUNING_HPP
+#define NETWORKING_SOCKET_TUNING_HPP
+
+#include "../pch.h"
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace net {
+    using namespace boost;
+
+    // Socket options applied at accept/connect time.
+    // Default constructed profile keeps kernel defaults, fields can be set one by one for custom profile
+    struct SocketTuning {
+        // Disables Nagle's algorithm, so small messages aren't delayed
+        bool no_delay{false};
+        // SO_SNDBUF and SO_RCVBUF in bytes, 0 keeps kernel default
+        int send_buffer_size{0};
+        int receive_buffer_size{0};
+        // Holds partial segments while a file is being sent, so headers and bodies share full segments
+        bool cork_file_transfers{false};
+        // SO_BUSY_POLL in microseconds, 0 disables it. Linux only, may need CAP_NET_ADMIN
+        int busy_poll_us{0};
+        // Re-arms TCP_QUICKACK after every read, so the peer isn't stalled by delayed ACKs. Linux only
+        bool quick_ack{false};
+
+        static SocketTuning latency() {
+            SocketTuning tuning;
+            tuning.no_delay = true;
+            tuning.busy_poll_us = 50;
+            tuning.quick_ack = true;
+            return tuning;
+        }
+
+        static SocketTuning bulk() {
+            SocketTuning tuning;
+            tuning.send_buffer_size = 4 << 20;
+            tuning.receive_buffer_size = 4 << 20;
+            tuning.cork_file_transfers = true;
+            return tuning;
+        }
+    };
+
+    inline void logTuningError(const char *option, const system::error_code &ec) {
+        if (ec)
+            std::clog << "[SocketTuning] Can't set " << option << ": " << ec.message() << "\n";
+    }
+
+    inline void setSocketOption(asio::ip::tcp::socket &socket, int level, int name, int value, const char *option) {
+#ifndef _WIN32
+        system::error_code ec;
+        if (::setsockopt(socket.native_handle(), level, name, &value, sizeof(value)) != 0)
+            ec.assign(errno, system::system_category());
+        logTuningError(option, ec);
+#endif
+    }
+
+    /// @brief Applies buffer sizes to acceptor or to opened, not yet connected socket.
+    /// Accepted sockets inherit them from acceptor
+    /// @details Must be done before the handshake, window scaling is negotiated in it
+    template<typename Socket>
+    inline void applyBufferSizes(Socket &socket, const SocketTuning &tuning) {
+        system::error_code ec;
+        if (tuning.send_buffer_size > 0)
+            logTuningError("SO_SNDBUF",
+                           socket.set_option(asio::socket_base::send_buffer_size{tuning.send_buffer_size}, ec));
+        if (tuning.receive_buffer_size > 0)
+            logTuningError("SO_RCVBUF",
+                           socket.set_option(asio::socket_base::receive_buffer_size{tuning.receive_buffer_size}, ec));
+    }
+
+    inline void applyTuning(asio::ip::tcp::acceptor &acceptor, const SocketTuning &tuning) {
+        applyBufferSizes(acceptor, tuning);
+    }
+
+    /// @brief Applies options of connected socket, buffer sizes are set by applyBufferSizes() beforehand
+    inline void applyTuning(asio::ip::tcp::socket &socket, const SocketTuning &tuning) {
+        system::error_code ec;
+        logTuningError("TCP_NODELAY", socket.set_option(asio::ip::tcp::no_delay{tuning.no_delay}, ec));
+#ifdef __linux__
+        if (tuning.busy_poll_us > 0)
+            setSocketOption(socket, SOL_SOCKET, SO_BUSY_POLL, tuning.busy_poll_us, "SO_BUSY_POLL");
+        if (tuning.quick_ack)
+            setSocketOption(socket, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+#endif
+    }
+
+    /// @brief Uncorking sends held partial segment right away
+    inline void setCork(asio::ip::tcp::socket &socket, bool cork) {
+#if defined(__linux__)
+        setSocketOption(socket, IPPROTO_TCP, TCP_CORK, cork, "TCP_CORK");
+#elif defined(TCP_NOPUSH)
+        setSocketOption(socket, IPPROTO_TCP, TCP_NOPUSH, cork, "TCP_NOPUSH");
+#endif
+    }
+
+    // Kernel clears TCP_QUICKACK by itself, so it's re-armed after reads
+    inline void rearmQuickAck(asio::ip::tcp::socket &socket) {
+#ifdef __linux__
+        setSocketOption(socket, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+#endif
+    }
+}
+
+#endif //NETWORKING_SOCKET_TUNING_HPP
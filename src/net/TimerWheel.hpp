@@ -0,0 +1,88 @@
+#ifndef NETWORKING_TIMER_WHEEL_HPP
+#define NETWORKING_TIMER_WHEEL_HPP
+
+#include "../pch.h"
+
+// Hashed timing wheel.
+// A single asio timer ticks for every scheduled callback, so scheduling and firing cost O(1)
+// no matter how many connections are watched.
+
+namespace net {
+    using namespace boost;
+
+    class TimerWheel {
+    public:
+        using Callback = std::function<void()>;
+
+        TimerWheel(asio::io_context &io_context, std::chrono::milliseconds tick, size_t slots) :
+                _timer(io_context), _tick(tick), _slots(slots) {
+        }
+
+        TimerWheel(const TimerWheel &) = delete;
+
+        /// @details Asynchronous function
+        void start() {
+            _timer.expires_after(_tick);
+            _timer.async_wait([this](system::error_code ec) { onTick(ec); });
+        }
+
+        void stop() {
+            _timer.cancel();
+        }
+
+        /// @brief Runs callback after delay rounded up to the tick
+        /// @details Must be called from io_context thread
+        void schedule(std::chrono::milliseconds delay, Callback callback) {
+            auto ticks = std::max<size_t>(1, static_cast<size_t>((delay + _tick - std::chrono::milliseconds{1}) / _tick));
+            auto &slot = _slots[(_current + ticks) % _slots.size()];
+            slot.push_back(Entry{(ticks - 1) / _slots.size(), std::move(callback)});
+        }
+
+        /// @brief Runs callback on every tick
+        /// @details Must be called from io_context thread
+        void everyTick(Callback callback) {
+            _on_tick.push_back(std::move(callback));
+        }
+
+    private:
+        struct Entry {
+            size_t rounds;
+            Callback callback;
+        };
+
+        void onTick(system::error_code ec) {
+            if (ec)
+                return;
+
+            _current = (_current + 1) % _slots.size();
+            std::vector<Entry> due;
+            auto &slot = _slots[_current];
+            for (auto it = slot.begin(); it != slot.end();) {
+                if (it->rounds == 0) {
+                    due.push_back(std::move(*it));
+                    it = slot.erase(it);
+                } else {
+                    --it->rounds;
+                    ++it;
+                }
+            }
+            // Callbacks may schedule again
+            for (auto &entry: due)
+                entry.callback();
+            for (auto &callback: _on_tick)
+                callback();
+
+            // Keeps the pace regardless of how long callbacks took
+            _timer.expires_at(_timer.expiry() + _tick);
+            _timer.async_wait([this](system::error_code ec) { onTick(ec); });
+        }
+
+        asio::steady_timer _timer;
+        std::chrono::milliseconds _tick;
+        std::vector<std::list<Entry>> _slots;
+        std::vector<Callback> _on_tick;
+        size_t _current{0};
+    };
+}
+
+#endif //NETWORKING_TIMER_WHEEL_HPP
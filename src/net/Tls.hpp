@@ -0,0 +1,207 @@
+#ifndef NETWORKING_TLS_HPP
+#define NETWORKING_TLS_HPP
+
+#include "../pch.h"
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+#ifdef __linux__
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
+
+namespace net {
+    using namespace boost;
+
+    // TLS 1.3 application traffic secrets captured from the OpenSSL key log callback.
+    // They are only used to hand the session over to kernel TLS and are never logged.
+    struct TlsSecrets {
+        std::vector<uint8_t> client_traffic_secret;
+        std::vector<uint8_t> server_traffic_secret;
+
+        // Freed memory must not keep key material
+        void wipe() {
+            for (auto *secret: {&client_traffic_secret, &server_traffic_secret}) {
+                OPENSSL_cleanse(secret->data(), secret->size());
+                secret->clear();
+                secret->shrink_to_fit();
+            }
+        }
+    };
+
+    // Index of the SSL ex_data slot holding the connection's TlsSecrets.
+    // Asio already owns the app_data slot for its verify callback.
+    inline int tlsSecretsIndex() {
+        static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    inline std::vector<uint8_t> fromHex(std::string_view hex) {
+        std::vector<uint8_t> bytes;
+        bytes.reserve(hex.size() / 2);
+        for (size_t i = 0; i + 1 < hex.size(); i += 2)
+            bytes.push_back(static_cast<uint8_t>(std::stoul(std::string{hex.substr(i, 2)}, nullptr, 16)));
+        return bytes;
+    }
+
+    // Key log lines look like "<LABEL> <client random> <secret>"
+    inline void onTlsKeyLog(const SSL *ssl, const char *line) {
+        auto *secrets = static_cast<TlsSecrets *>(SSL_get_ex_data(ssl, tlsSecretsIndex()));
+        if (!secrets)
+            return;
+
+        std::string_view entry{line};
+        auto label_end = entry.find(' ');
+        auto secret_begin = entry.rfind(' ');
+        if (label_end == std::string_view::npos || secret_begin == label_end)
+            return;
+
+        auto label = entry.substr(0, label_end);
+        auto secret = entry.substr(secret_begin + 1);
+        if (label == "CLIENT_TRAFFIC_SECRET_0")
+            secrets->client_traffic_secret = fromHex(secret);
+        else if (label == "SERVER_TRAFFIC_SECRET_0")
+            secrets->server_traffic_secret = fromHex(secret);
+    }
+
+    /// @brief Server side context, certificate and private key are PEM files
+    inline asio::ssl::context makeServerTlsContext(const std::string &certificate, const std::string &private_key) {
+        asio::ssl::context context{asio::ssl::context::tls_server};
+        context.set_options(asio::ssl::context::default_workarounds |
+                            asio::ssl::context::no_sslv2 | asio::ssl::context::no_sslv3 |
+                            asio::ssl::context::no_tlsv1 | asio::ssl::context::no_tlsv1_1);
+        context.use_certificate_chain_file(certificate);
+        context.use_private_key_file(private_key, asio::ssl::context::pem);
+        // Session tickets would be sent on the application traffic keys right after the handshake
+        // and shift the record sequence number that kernel TLS has to start from
+        SSL_CTX_set_num_tickets(context.native_handle(), 0);
+        SSL_CTX_set_keylog_callback(context.native_handle(), onTlsKeyLog);
+        return context;
+    }
+
+    /// @brief Client side context, server certificate is verified against ca_file or system CAs
+    /// @param verify false accepts any certificate, for testing only
+    inline asio::ssl::context makeClientTlsContext(const std::string &ca_file = "", bool verify = true) {
+        asio::ssl::context context{asio::ssl::context::tls_client};
+        context.set_options(asio::ssl::context::default_workarounds |
+                            asio::ssl::context::no_sslv2 | asio::ssl::context::no_sslv3 |
+                            asio::ssl::context::no_tlsv1 | asio::ssl::context::no_tlsv1_1);
+        if (verify) {
+            if (!ca_file.empty())
+                context.load_verify_file(ca_file);
+            else
+                context.set_default_verify_paths();
+            context.set_verify_mode(asio::ssl::verify_peer);
+        } else {
+            std::clog << "[TLS] Server certificate isn't verified!\n";
+            context.set_verify_mode(asio::ssl::verify_none);
+        }
+        SSL_CTX_set_keylog_callback(context.native_handle(), onTlsKeyLog);
+        return context;
+    }
+
+    /// @brief Sends host name as SNI and makes certificate verification check it
+    /// @details IP addresses are matched against the certificate's IP entries and aren't sent as SNI
+    inline bool setTlsPeerName(SSL *ssl, const std::string &host) {
+        system::error_code ec;
+        asio::ip::make_address(host, ec);
+        if (!ec)
+            return X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str()) == 1;
+        return SSL_set_tlsext_host_name(ssl, host.c_str()) == 1 && SSL_set1_host(ssl, host.c_str()) == 1;
+    }
+
+    // HKDF-Expand-Label from RFC 8446, section 7.1
+    inline bool hkdfExpandLabel(const EVP_MD *md, const std::vector<uint8_t> &secret,
+                                const std::string &label, uint8_t *out, size_t out_length) {
+        std::string full_label{"tls13 " + label};
+        std::vector<uint8_t> info;
+        info.push_back(static_cast<uint8_t>(out_length >> 8));
+        info.push_back(static_cast<uint8_t>(out_length & 0xff));
+        info.push_back(static_cast<uint8_t>(full_label.size()));
+        info.insert(info.end(), full_label.begin(), full_label.end());
+        info.push_back(0);
+
+        EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+        size_t length = out_length;
+        bool ok = pctx &&
+                  EVP_PKEY_derive_init(pctx) > 0 &&
+                  EVP_PKEY_CTX_set_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+                  EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0 &&
+                  EVP_PKEY_CTX_set1_hkdf_key(pctx, secret.data(), static_cast<int>(secret.size())) > 0 &&
+                  EVP_PKEY_CTX_add1_hkdf_info(pctx, info.data(), static_cast<int>(info.size())) > 0 &&
+                  EVP_PKEY_derive(pctx, out, &length) > 0;
+        EVP_PKEY_CTX_free(pctx);
+        return ok && length == out_length;
+    }
+
+    /// @brief Hands the transmit direction of an established TLS 1.3 session to the kernel
+    /// @details Afterwards plain writes and sendfile(2) on the socket are encrypted by the kernel,
+    /// nothing may be written through OpenSSL any more. Receiving stays in user space.
+    /// @returns false if kernel TLS is unavailable or the session can't be offloaded
+    inline bool enableKernelTlsTx(SSL *ssl, int fd, const TlsSecrets &secrets, bool is_server) {
+#if defined(__linux__) && defined(TLS_1_3_VERSION)
+        if (SSL_version(ssl) != TLS1_3_VERSION)
+            return false;
+        // Any ticket sent by the server has already consumed a record sequence number
+        if (is_server && SSL_get_num_tickets(ssl) != 0)
+            return false;
+
+        const auto &secret = is_server ? secrets.server_traffic_secret : secrets.client_traffic_secret;
+        if (secret.empty())
+            return false;
+
+        std::string_view cipher{SSL_CIPHER_get_name(SSL_get_current_cipher(ssl))};
+        if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+            return false;
+
+        // Record sequence number stays zero, no application data was sent yet
+        if (cipher == "TLS_AES_128_GCM_SHA256") {
+            tls12_crypto_info_aes_gcm_128 crypto_info{};
+            crypto_info.info.version = TLS_1_3_VERSION;
+            crypto_info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+            std::array<uint8_t, TLS_CIPHER_AES_GCM_128_SALT_SIZE + TLS_CIPHER_AES_GCM_128_IV_SIZE> iv{};
+            bool offloaded =
+                    hkdfExpandLabel(EVP_sha256(), secret, "key", crypto_info.key, sizeof(crypto_info.key)) &&
+                    hkdfExpandLabel(EVP_sha256(), secret, "iv", iv.data(), iv.size());
+            if (offloaded) {
+                std::copy_n(iv.begin(), sizeof(crypto_info.salt), crypto_info.salt);
+                std::copy_n(iv.begin() + sizeof(crypto_info.salt), sizeof(crypto_info.iv), crypto_info.iv);
+                offloaded = setsockopt(fd, SOL_TLS, TLS_TX, &crypto_info, sizeof(crypto_info)) == 0;
+            }
+            OPENSSL_cleanse(&crypto_info, sizeof(crypto_info));
+            OPENSSL_cleanse(iv.data(), iv.size());
+            return offloaded;
+        }
+        if (cipher == "TLS_AES_256_GCM_SHA384") {
+            tls12_crypto_info_aes_gcm_256 crypto_info{};
+            crypto_info.info.version = TLS_1_3_VERSION;
+            crypto_info.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+            std::array<uint8_t, TLS_CIPHER_AES_GCM_256_SALT_SIZE + TLS_CIPHER_AES_GCM_256_IV_SIZE> iv{};
+            bool offloaded =
+                    hkdfExpandLabel(EVP_sha384(), secret, "key", crypto_info.key, sizeof(crypto_info.key)) &&
+                    hkdfExpandLabel(EVP_sha384(), secret, "iv", iv.data(), iv.size());
+            if (offloaded) {
+                std::copy_n(iv.begin(), sizeof(crypto_info.salt), crypto_info.salt);
+                std::copy_n(iv.begin() + sizeof(crypto_info.salt), sizeof(crypto_info.iv), crypto_info.iv);
+                offloaded = setsockopt(fd, SOL_TLS, TLS_TX, &crypto_info, sizeof(crypto_info)) == 0;
+            }
+            OPENSSL_cleanse(&crypto_info, sizeof(crypto_info));
+            OPENSSL_cleanse(iv.data(), iv.size());
+            return offloaded;
+        }
+        // The ULP is attached already but without TX keys the socket still behaves like plain TCP
+        return false;
+#else
+        return false;
+#endif
+    }
+}
+
+#endif //NETWORKING_TLS_HPP
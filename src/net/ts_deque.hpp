@@ -46,8 +46,10 @@ namespace net {
 
         // Adds an item to back of Queue
         void push_back(const T &item) {
-            std::scoped_lock lock(_deque_mutex);
-            _deque.emplace_back(std::move(item));
+            {
+                std::scoped_lock lock(_deque_mutex);
+                _deque.emplace_back(std::move(item));
+            }
 
             std::unique_lock<std::mutex> ul(_blocking_mutex);
             cv_blocking.notify_one();
@@ -55,8 +57,10 @@ namespace net {
 
         // Adds an item to front of Queue
         void push_front(const T &item) {
-            std::scoped_lock lock(_deque_mutex);
-            _deque.emplace_front(std::move(item));
+            {
+                std::scoped_lock lock(_deque_mutex);
+                _deque.emplace_front(std::move(item));
+            }
 
             std::unique_lock<std::mutex> ul(_blocking_mutex);
             cv_blocking.notify_one();
@@ -86,11 +90,11 @@ namespace net {
             _deque.clear();
         }
 
+        // Blocks until Queue has items
         void wait() {
-            while (empty()) {
-                std::unique_lock<std::mutex> ul(_blocking_mutex);
-                cv_blocking.wait(ul);
-            }
+            // Pushers notify under _blocking_mutex, so checking under it can't miss a wakeup
+            std::unique_lock<std::mutex> ul(_blocking_mutex);
+            cv_blocking.wait(ul, [this]() { return !empty(); });
         }
 
     protected:
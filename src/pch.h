@@ -10,6 +10,8 @@
 #include <initializer_list>
 #include <regex>
 #include <set>
+#include <map>
+#include <sstream>
 #include <chrono>
 #include <functional>
 #include <array>
@@ -18,6 +20,9 @@
 #include <bitset>
 #include <cassert>
 #include <deque>
+#include <list>
+#include <optional>
+#include <future>
 
 #ifdef _WIN32
 #define _WIN32_WINNT 0x0A00
@@ -26,6 +31,7 @@
 #include <boost/asio.hpp>
 #include <boost/asio/ts/buffer.hpp>
 #include <boost/asio/ts/internet.hpp>
+#include <boost/asio/ssl.hpp>
 
 #include <boost/filesystem.hpp>
 //using namespace boost;